@@ -90,6 +90,8 @@ int main( int argc, char** argv )
 	
 	try
 	{
+		synced_batch batch( protocol_in, protocol_out );
+		
 		int lock_fd = OPEN( PORT "/lock" );
 		
 		PUT( PORT "/procid", "4" "\n" );
@@ -131,6 +133,8 @@ int main( int argc, char** argv )
 		PUT( PORT "/w/text-font", "0" "\n" );
 		
 		PUT( PORT "/w/vis", "1" "\n" );
+		
+		batch.finish();
 	}
 	catch ( const path_error& e )
 	{
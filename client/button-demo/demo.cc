@@ -202,6 +202,8 @@ int main( int argc, char** argv )
 	
 	try
 	{
+		synced_batch batch( protocol_in, protocol_out );
+		
 		int lock_fd = OPEN( PORT "/lock" );
 		
 		PUT( PORT "/.~title", "Demo" );
@@ -215,6 +217,8 @@ int main( int argc, char** argv )
 		PUT( PORT "/v/v/title", "Demo" "\n" );
 		
 		int window_fd = OPEN( PORT "/window" );
+		
+		batch.finish();
 	}
 	catch ( const path_error& e )
 	{
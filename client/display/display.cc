@@ -5,7 +5,13 @@
 
 // POSIX
 #include <fcntl.h>
+#include <time.h>
 #include <unistd.h>
+#include <sys/time.h>
+
+// Standard C++
+#include <algorithm>
+#include <vector>
 
 // Standard C
 #include <errno.h>
@@ -39,8 +45,17 @@
 // poseven
 #include "poseven/types/errno_t.hh"
 
+// freemount
+#include "freemount/message.hh"
+#include "freemount/pass_fd.hh"
+#include "freemount/xor_delta.hh"
+
 // freemount-client
 #include "freemount/address.hh"
+#include "freemount/cache.hh"
+#include "freemount/seed_waiter.hh"
+#include "freemount/connection.hh"
+#include "freemount/pwrite_pipeline.hh"
 #include "freemount/synced.hh"
 
 
@@ -55,9 +70,11 @@
 
 #define NO_MONOCHROME_LIGHT  "monochrome 'light' rasters aren't yet supported"
 
-#define POLLING_ENSUES  \
-	"GRAPHICS_UPDATE_SIGNAL_FIFO is unset -- will poll every 10ms instead"
+#define NO_DELTAS  "the GUI doesn't accept deltas -- will send full rows instead"
 
+#define POLLING_ENSUES  \
+	"GRAPHICS_UPDATE_SIGNAL_FIFO is unset -- will wait on the sync seed instead"
+	
 #define ERROR( msg )  write( STDERR_FILENO, STR_LEN( PROGRAM ": " msg "\n" ) )
 
 namespace p7 = poseven;
@@ -69,6 +86,8 @@ const size_t max_payload = uint16_t( -1 );
 
 enum
 {
+	Opt_delta   = 'd',
+	Opt_fps     = 'f',
 	Opt_gui     = 'g',
 	Opt_mnt     = 'm',
 	Opt_title   = 't',
@@ -78,6 +97,8 @@ enum
 
 static command::option options[] =
 {
+	{ "delta",   Opt_delta                            },
+	{ "fps",     Opt_fps,     command::Param_required },
 	{ "gui",     Opt_gui,     command::Param_required },
 	{ "mnt",     Opt_mnt,     command::Param_required },
 	{ "title",   Opt_title,   command::Param_required },
@@ -93,6 +114,9 @@ static char*        mnt_path;
 static const char* title;
 
 static bool watching;
+static bool sending_deltas;
+
+static unsigned max_fps;
 
 static unsigned x_numerator   = 1;
 static unsigned x_denominator = 1;
@@ -103,18 +127,21 @@ static int protocol_out = -1;
 
 static int next_fd = 3;
 
+static connection* raster_connection;
+
 static raster::raster_load loaded_raster;
 
+static int shareable_raster_fd = -1;
+
+static short raster_width;
+
 
 #define OPEN( path )  \
 	synced_open( protocol_in, protocol_out, next_fd++, STR_LEN( path ) )
-
+	
 #define PUT( path, data, size )  \
 	synced_put( protocol_in, protocol_out, STR_LEN( path ), data, size )
-
-#define PWRITE( path, data, size, off )  \
-	synced_pwrite( protocol_in, protocol_out, STR_LEN( path ), data, size, off )
-
+	
 #define LINK( src, dst )  \
 	synced_link( protocol_in, protocol_out, STR_LEN( src ), STR_LEN( dst ) )
 
@@ -131,6 +158,28 @@ void report_error( const char* path, uint32_t err )
 	more::perror( PROGRAM, path, err );
 }
 
+/*
+	Optional GUI properties are looked up through a client_cache, so each
+	costs at most one round trip however often it's checked.
+*/
+
+static client_cache gui_cache;
+
+static
+bool gui_has( const char* path )
+{
+	try
+	{
+		gui_cache.stat( protocol_in, protocol_out, path );
+	}
+	catch ( const path_error& )
+	{
+		return false;
+	}
+	
+	return true;
+}
+
 static
 const char* default_gui()
 {
@@ -172,7 +221,14 @@ raster::sync_relay* open_raster( const char* path )
 		exit( 1 );
 	}
 	
-	close( raster_fd );
+	if ( watching )
+	{
+		shareable_raster_fd = raster_fd;
+	}
+	else
+	{
+		close( raster_fd );
+	}
 	
 	if ( watching )
 	{
@@ -216,6 +272,14 @@ char* const* get_options( char** argv )
 				title = global_result.param;
 				break;
 			
+			case Opt_delta:
+				sending_deltas = true;
+				break;
+			
+			case Opt_fps:
+				max_fps = parse_unsigned_decimal( global_result.param );
+				break;
+			
 			case Opt_watch:
 				watching = true;
 				break;
@@ -252,29 +316,370 @@ char* const* get_options( char** argv )
 	return argv;
 }
 
+/*
+	Raster data goes out through a pwrite_pipeline, so all of a frame's
+	chunks are sent back to back, and their results are collected at the
+	end, rather than waiting a round trip per chunk.
+*/
+
 static
 void write_image( const char* base, size_t image_size, size_t chunk_size )
 {
-	size_t n_written = 0;
+	pwrite_pipeline pipeline( *raster_connection, PORT "/v/data", chunk_size );
+	
+	pipeline.pwrite( base, image_size, 0 );
+	pipeline.finish();
+}
+
+/*
+	In watch mode, we keep a copy of the last frame sent, and send only the
+	rows that have changed since.  Changed rows separated by fewer than
+	max_gap_size bytes of unchanged ones are sent together, since a few
+	redundant bytes are cheaper than another request.
+*/
+
+const size_t max_gap_size = 4096;
+
+static std::vector< char > last_frame;
+
+static inline
+bool row_changed( const char* base, size_t row, size_t stride )
+{
+	const size_t offset = row * stride;
+	
+	return memcmp( base + offset, &last_frame[ offset ], stride ) != 0;
+}
+
+/*
+	When the GUI is on the same host, we needn't copy pixels at all:  We
+	pass the raster file's descriptor to the GUI, which maps it, and then
+	send only the bounds of the rows that change.  If the connection isn't
+	a local socket, or the GUI doesn't accept the descriptor, we write the
+	raster data as usual.
+*/
+
+static bool sharing_raster;
+
+static
+void record_share_result( void* that, uint32_t result )
+{
+	*(uint32_t*) that = result;
+}
+
+static
+bool share_raster( int fd, uint32_t image_size )
+{
+	if ( fd < 0  ||  ! is_unix_socket( protocol_out ) )
+	{
+		return false;
+	}
+	
+	const uint32_t extent[ 2 ] = { 0, image_size };  // offset, length
+	
+	uint32_t result = 0;
+	
+	const int r_id = raster_connection->begin_request( NULL,
+	                                                   &record_share_result,
+	                                                   &result );
+	
+	if ( r_id < 0 )
+	{
+		return false;
+	}
+	
+	typedef message< arg_path, arg_data > share_message;
+	
+	share_message m( req_write,
+	                 arg_path( STR_LEN( PORT "/v/shared" ) ),
+	                 arg_data( (const char*) extent, sizeof extent ),
+	                 r_id );
+	
+	send_with_fd( protocol_out, m, fd );
+	
+	return raster_connection->wait( r_id ) == 0  &&  result == 0;
+}
+
+static
+void notify_dirty( size_t first_row, size_t end_row )
+{
+	const short rect[ 4 ] = { (short) first_row, 0, (short) end_row, raster_width };
+	
+	PUT( PORT "/v/dirty", (const char*) rect, sizeof rect );
+}
+
+/*
+	With --delta, each chunk of changed rows is sent to v/delta as an XOR
+	delta (see xor_delta.hh) against the previous frame, which the GUI
+	applies to its copy.  Chunks the encoding doesn't shrink go to v/data
+	as usual.
+*/
+
+static
+void write_deltas( pwrite_pipeline&  raw,
+                   pwrite_pipeline&  deltas,
+                   const char*       base,
+                   size_t            offset,
+                   size_t            size,
+                   size_t            chunk_size )
+{
+	static std::vector< char > fresh;
+	static std::vector< char > delta;
+	
+	fresh.resize( chunk_size );
+	delta.resize( max_xor_delta_size( chunk_size ) );
 	
-	while ( n_written < image_size - chunk_size )
+	for ( size_t i = 0;  i < size;  i += chunk_size )
 	{
-		PWRITE( PORT "/v/data", base, chunk_size, n_written );
+		const size_t n = min( chunk_size, size - i );
+		
+		char* copy = &last_frame[ offset + i ];
+		
+		// Snapshot the rows first, in case the producer is mid-update.
+		
+		memcpy( &fresh[ 0 ], base + offset + i, n );
+		
+		const size_t n_encoded = encode_xor_delta( &fresh[ 0 ], copy, n, &delta[ 0 ] );
 		
-		n_written += chunk_size;
-		base      += chunk_size;
+		memcpy( copy, &fresh[ 0 ], n );
+		
+		if ( n_encoded < n )
+		{
+			deltas.pwrite( &delta[ 0 ], n_encoded, offset + i );
+		}
+		else
+		{
+			raw.pwrite( copy, n, offset + i );
+		}
 	}
+}
+
+static
+void write_changes( const char* base, size_t stride, size_t chunk_size )
+{
+	const size_t height = last_frame.size() / stride;
+	
+	const size_t max_gap_rows = max_gap_size / stride;
+	
+	size_t dirty_top    = height;
+	size_t dirty_bottom = 0;
+	
+	pwrite_pipeline pipeline( *raster_connection, PORT "/v/data",  chunk_size );
+	pwrite_pipeline deltas  ( *raster_connection, PORT "/v/delta", chunk_size );
 	
-	if ( size_t remainder = image_size - n_written )
+	size_t row = 0;
+	
+	while ( true )
 	{
-		PWRITE( PORT "/v/data", base, remainder, n_written );
+		while ( row < height  &&  ! row_changed( base, row, stride ) )
+		{
+			++row;
+		}
+		
+		if ( row == height )
+		{
+			break;
+		}
+		
+		const size_t first = row;
+		
+		size_t end = ++row;  // one past the last changed row
+		
+		while ( row < height  &&  row - end <= max_gap_rows )
+		{
+			if ( row_changed( base, row++, stride ) )
+			{
+				end = row;
+			}
+		}
+		
+		row = end;
+		
+		const size_t offset = first * stride;
+		const size_t size   = (end - first) * stride;
+		
+		if ( sharing_raster )
+		{
+			// The GUI reads the rows itself; we just note what changed.
+			
+			memcpy( &last_frame[ offset ], base + offset, size );
+			
+			dirty_top    = min( dirty_top, first );
+			dirty_bottom = end;
+			continue;
+		}
+		
+		if ( sending_deltas )
+		{
+			write_deltas( pipeline, deltas, base, offset, size, chunk_size );
+			continue;
+		}
+		
+		/*
+			Send from our copy, so the rows we send are the rows we'll
+			compare against next time, even if the producer is mid-update.
+		*/
+		
+		char* copy = &last_frame[ offset ];
+		
+		memcpy( copy, base + offset, size );
+		
+		pipeline.pwrite( copy, size, offset );
+	}
+	
+	pipeline.finish();
+	
+	try
+	{
+		deltas.finish();
+	}
+	catch ( const path_error& )
+	{
+		/*
+			The GUI refused a delta, so its copy of those rows is stale.
+			Stop sending deltas, and resend the whole frame.
+		*/
+		
+		ERROR( NO_DELTAS );
+		
+		sending_deltas = false;
+		
+		write_image( &last_frame[ 0 ], last_frame.size(), chunk_size );
+	}
+	
+	if ( dirty_top < dirty_bottom )
+	{
+		notify_dirty( dirty_top, dirty_bottom );
+	}
+}
+
+/*
+	When the magnification is 1/n, we shrink the raster ourselves before
+	sending it, rather than sending n^2 times as many pixels for the GUI
+	to throw away.  Each destination pixel is the average of an n-by-n
+	box of source pixels, channel by channel.  That's only meaningful for
+	direct 32-bit pixels; other depths are sent at full size, as before.
+*/
+
+static unsigned downscale_factor = 1;
+
+static size_t source_stride;
+
+static std::vector< char > downscaled;
+
+static
+unsigned get_downscale_factor( const raster::raster_desc& desc )
+{
+	if ( desc.weight != 32  ||  x_numerator != 1 )
+	{
+		return 1;
+	}
+	
+	const unsigned n = x_denominator;
+	
+	return n <= 16  &&  desc.width >= n  &&  desc.height >= n ? n : 1;
+}
+
+static
+void box_filter( const uint8_t*  src,
+                 uint8_t*        dst,
+                 size_t          width,
+                 size_t          height,
+                 unsigned        n )
+{
+	const size_t row_size = width * 4;
+	const uint32_t area = n * n;
+	
+	std::vector< uint32_t > sums( row_size );
+	
+	for ( size_t y = 0;  y < height;  ++y )
+	{
+		std::fill( sums.begin(), sums.end(), 0 );
+		
+		uint32_t* sum = &sums[ 0 ];
+		
+		for ( unsigned dy = 0;  dy < n;  ++dy )
+		{
+			const uint8_t* p = src + (y * n + dy) * source_stride;
+			
+			// Simple, dependency-free loops, which compilers vectorize.
+			
+			for ( size_t x = 0;  x < width;  ++x )
+			{
+				for ( unsigned dx = 0;  dx < n;  ++dx )
+				{
+					for ( int c = 0;  c < 4;  ++c )
+					{
+						sum[ x * 4 + c ] += *p++;
+					}
+				}
+			}
+		}
+		
+		for ( size_t i = 0;  i < row_size;  ++i )
+		{
+			*dst++ = (sum[ i ] + area / 2) / area;
+		}
+	}
+}
+
+static
+const char* current_frame( const char* base )
+{
+	if ( downscale_factor == 1 )
+	{
+		return base;
+	}
+	
+	const raster::raster_desc& desc = loaded_raster.meta->desc;
+	
+	const unsigned n = downscale_factor;
+	
+	box_filter( (const uint8_t*) base,
+	            (uint8_t*) &downscaled[ 0 ],
+	            desc.width  / n,
+	            desc.height / n,
+	            n );
+	
+	return &downscaled[ 0 ];
+}
+
+/*
+	Frames are coalesced:  We read the seed only when we're ready to send,
+	so however many frames the producer renders during an upload, we send
+	just the newest.  An upload doesn't finish until its results are in,
+	so there's never more than one frame in flight, and on a slow link the
+	latency is bounded by one upload rather than growing with a backlog.
+	
+	With --fps, we also wait out the rest of each frame's interval (timed
+	from the start of its upload) before sending the next, and coalesce
+	whatever the producer renders meanwhile.
+*/
+
+static
+uint64_t microseconds()
+{
+	timeval tv;
+	
+	gettimeofday( &tv, NULL );
+	
+	return uint64_t( tv.tv_sec ) * 1000000 + tv.tv_usec;
+}
+
+static
+void sleep_microseconds( uint64_t n )
+{
+	timespec duration = { time_t( n / 1000000 ), long( n % 1000000 * 1000 ) };
+	
+	while ( nanosleep( &duration, &duration ) < 0  &&  errno == EINTR )
+	{
+		continue;
 	}
 }
 
 static
 void update_loop( raster::sync_relay*  sync,
                   const char*          base,
-                  size_t               image_size,
+                  size_t               stride,
                   size_t               chunk_size )
 {
 	const char* update_fifo = getenv( "GRAPHICS_UPDATE_SIGNAL_FIFO" );
@@ -284,6 +689,12 @@ void update_loop( raster::sync_relay*  sync,
 		ERROR( POLLING_ENSUES );
 	}
 	
+	seed_waiter waiter;
+	
+	const uint64_t frame_interval = max_fps ? 1000000 / max_fps : 0;
+	
+	uint64_t next_frame = 0;
+	
 	uint32_t seed = 0;
 	
 	while ( sync->status == raster::Sync_ready )
@@ -292,17 +703,37 @@ void update_loop( raster::sync_relay*  sync,
 		{
 			if ( update_fifo )
 			{
+				/*
+					Opening the FIFO for writing blocks until the producer
+					opens it for reading, which it does after each update.
+					The open() is the wait, so it's repeated every time.
+				*/
+				
 				close( open( update_fifo, O_WRONLY ) );
 			}
 			else
 			{
-				usleep( 10000 );  // 10ms
+				waiter.wait( &sync->seed, seed );
+			}
+		}
+		
+		if ( frame_interval )
+		{
+			uint64_t now = microseconds();
+			
+			if ( now < next_frame )
+			{
+				sleep_microseconds( next_frame - now );
+				
+				now = next_frame;
 			}
+			
+			next_frame = now + frame_interval;
 		}
 		
 		seed = sync->seed;
 		
-		write_image( base, image_size, chunk_size );
+		write_changes( current_frame( base ), stride, chunk_size );
 	}
 }
 
@@ -397,6 +828,24 @@ int main( int argc, char** argv )
 	protocol_in  = the_connection.get_input ();
 	protocol_out = the_connection.get_output();
 	
+	if ( sending_deltas )
+	{
+		// The cache negotiates, which must precede other requests.
+		
+		const int granted = gui_cache.negotiate( protocol_in, protocol_out );
+		
+		if ( granted < 0 )
+		{
+			more::perror( PROGRAM ": connection error", -granted );
+			
+			return 1;
+		}
+	}
+	
+	connection raster_uploads( protocol_in, protocol_out );
+	
+	raster_connection = &raster_uploads;
+	
 	const raster::raster_desc& desc = loaded_raster.meta->desc;
 	
 	if ( desc.model == raster::Model_monochrome_light )
@@ -407,12 +856,30 @@ int main( int argc, char** argv )
 	
 	const char* base = (char*) loaded_raster.addr;
 	
-	const size_t chunk_height = min( desc.height, max_payload / desc.stride );
+	downscale_factor = get_downscale_factor( desc );
+	
+	const unsigned n = downscale_factor;
+	
+	const size_t width  = desc.width  / n;
+	const size_t height = desc.height / n;
+	
+	const size_t row_size = n > 1 ? width * 4 : desc.stride;
+	
+	source_stride = desc.stride;
+	
+	raster_width = width;
 	
-	const size_t chunk_size = chunk_height * desc.stride;
-	const size_t image_size = desc.height * desc.stride;
+	const size_t chunk_height = min( height, max_payload / row_size );
 	
-	short stride = desc.stride;
+	const size_t chunk_size = chunk_height * row_size;
+	const size_t image_size = height * row_size;
+	
+	if ( n > 1 )
+	{
+		downscaled.resize( image_size );
+	}
+	
+	short stride = row_size;
 	char  depth  = desc.weight;
 	
 	if ( depth == 16  &&  ! is_16bit_565( desc ) )
@@ -440,16 +907,23 @@ int main( int argc, char** argv )
 		little_endian = false;
 	}
 	
-	short raster_size[ 2 ] = { (short) desc.height, (short) desc.width };
+	short raster_size[ 2 ] = { (short) height, (short) width };
 	short window_size[ 2 ] = { (short) desc.height, (short) desc.width };
 	
-	if ( x_numerator > 1  &&  x_numerator <= 16 )
+	if ( n > 1 )
+	{
+		// We've already applied the magnification.
+		
+		window_size[ 0 ] = height;
+		window_size[ 1 ] = width;
+	}
+	else if ( x_numerator > 1  &&  x_numerator <= 16 )
 	{
 		window_size[ 0 ] *= x_numerator;
 		window_size[ 1 ] *= x_numerator;
 	}
 	
-	if ( x_denominator > 1 )
+	if ( x_denominator > 1  &&  n == 1 )
 	{
 		window_size[ 0 ] /= x_denominator;
 		window_size[ 1 ] /= x_denominator;
@@ -488,6 +962,13 @@ int main( int argc, char** argv )
 			PUT( PORT "/v/.~stride", (const char*) &stride, sizeof stride );
 		}
 		
+		if ( sending_deltas  &&  ! gui_has( PORT "/v/delta" ) )
+		{
+			ERROR( NO_DELTAS );
+			
+			sending_deltas = false;
+		}
+		
 		try
 		{
 			PUT( PORT "/compositing", "1" "\n", 2 );
@@ -506,13 +987,34 @@ int main( int argc, char** argv )
 			PUT( PORT "/.~title",  title, strlen( title ) );
 		}
 		
-		write_image( base, image_size, chunk_size );
+		const char* image = current_frame( base );
+		
+		if ( sync )
+		{
+			last_frame.assign( image, image + image_size );
+			
+			image = &last_frame[ 0 ];
+			
+			// The GUI can't share our downscaled copy, only the raster.
+			
+			sharing_raster = n == 1  &&  share_raster( shareable_raster_fd,
+			                                           image_size );
+		}
+		
+		if ( sharing_raster )
+		{
+			notify_dirty( 0, desc.height );
+		}
+		else
+		{
+			write_image( image, image_size, chunk_size );
+		}
 		
 		int window_fd = OPEN( PORT "/window" );
 		
 		if ( sync )
 		{
-			update_loop( sync, base, image_size, chunk_size );
+			update_loop( sync, base, row_size, chunk_size );
 			
 			return 0;
 		}
@@ -25,6 +25,7 @@
 
 // freemount-client
 #include "freemount/address.hh"
+#include "freemount/negotiate.hh"
 #include "freemount/requests.hh"
 
 
@@ -72,7 +73,7 @@ int frame_handler( void* that, const frame_header& frame )
 			break;
 		
 		case Frame_recv_data:
-			send_read_ack( protocol_out, get_size( frame ) );
+			((read_ack_queue*) that)->acknowledge( get_size( frame ) );
 			
 			write( STDOUT_FILENO, get_data( frame ), get_size( frame ) );
 			break;
@@ -120,9 +121,22 @@ int main( int argc, char** argv )
 		the_path = "/";
 	}
 	
+	session_params params;
+	
+	int negotiated = negotiate( protocol_in, protocol_out, default_features(), params );
+	
+	if ( negotiated < 0 )
+	{
+		more::perror( "fcat", -negotiated );
+		
+		return 1;
+	}
+	
 	send_read_request( protocol_out, the_path, strlen( the_path ) );
 	
-	data_receiver r( &frame_handler, NULL );
+	read_ack_queue acks( protocol_out, read_ack_threshold( params ) );
+	
+	data_receiver r( &frame_handler, &acks, &flush_read_acks );
 	
 	int looped = run_event_loop( r, protocol_in );
 	
@@ -27,19 +27,23 @@
 // freemount
 #include "freemount/event_loop.hh"
 #include "freemount/frame_size.hh"
-#include "freemount/queue_utils.hh"
+#include "freemount/message.hh"
 #include "freemount/receiver.hh"
 #include "freemount/send_ack.hh"
-#include "freemount/send_queue.hh"
 #include "freemount/write_in_full.hh"
 
 // freemount-client
 #include "freemount/address.hh"
+#include "freemount/negotiate.hh"
+
+// fget
+#include "update.hh"
 
 
 #define STR_LEN( s )  "" s, (sizeof s - 1)
 
 
+using namespace command::constants;
 using namespace freemount;
 
 
@@ -48,6 +52,8 @@ enum
 	Option_clobber  = 'C',
 	Option_continue = 'c',  // resume downloads
 	Option_quiet    = 'q',
+	Option_ranges   = 'r',  // parallel range requests
+	Option_update   = 'u',  // fetch only changed blocks
 };
 
 static command::option options[] =
@@ -55,6 +61,8 @@ static command::option options[] =
 	{ "clobber",  Option_clobber  },
 	{ "continue", Option_continue },
 	{ "quiet",    Option_quiet    },
+	{ "ranges",   Option_ranges, Param_required },
+	{ "update",   Option_update   },
 	{ NULL }
 };
 
@@ -74,11 +82,36 @@ static unsigned long long n_written;
 
 static bool clobbering;
 static bool resume_downloads;
+static bool updating;
 static bool show_progress;
 static float the_divisor;
 
 static int the_result;
 
+/*
+	In ranged mode, the file is split into n_ranges pieces, each fetched by
+	its own read request (with id i + 1) and written with pwrite().  They
+	all share the connection, so the server works on them concurrently.
+	
+	That helps when the server's disk or CPU is the limit, but not when
+	it's the server's congestion window (freemountd --window), which is
+	shared by all of its transfers:  n ranges get one window's worth of
+	data per round trip between them, just as one read does.
+*/
+
+const int max_ranges = 64;
+
+struct range
+{
+	unsigned long long offset;  // where the next data goes
+	unsigned long long end;
+};
+
+static range the_ranges[ max_ranges ];
+
+static int n_ranges = 1;
+static int n_ranges_done;
+
 
 static
 void update_progress()
@@ -131,12 +164,12 @@ int frame_handler( void* that, const frame_header& frame )
 			break;
 		
 		case Frame_recv_data:
-			uint16_t size;
+			uint32_t size;
 			size = get_size( frame );
 			
 			n_written += size;
 			
-			send_read_ack( protocol_out, size );
+			((read_ack_queue*) that)->acknowledge( size );
 			
 			update_progress();
 			
@@ -161,6 +194,96 @@ int frame_handler( void* that, const frame_header& frame )
 	return 0;
 }
 
+static
+int stat_frame_handler( void* that, const frame_header& frame )
+{
+	switch ( frame.type )
+	{
+		case Frame_fatal:
+		case Frame_error:
+		case Frame_debug:
+			return frame_handler( that, frame );
+		
+		case Frame_stat_size:
+			the_expected_size = get_u64( frame );
+			the_divisor       = the_expected_size / 100.0;
+			break;
+		
+		case Frame_result:
+			the_result = get_u32( frame );
+			return 1;
+		
+		default:
+			break;
+	}
+	
+	return 0;
+}
+
+static
+int range_frame_handler( void* that, const frame_header& frame )
+{
+	const uint16_t id = get_request_id( frame );
+	
+	switch ( frame.type )
+	{
+		case Frame_fatal:
+		case Frame_error:
+		case Frame_debug:
+			return frame_handler( that, frame );
+		
+		case Frame_stat_size:
+			break;
+		
+		case Frame_recv_data:
+			if ( id == 0  ||  id > n_ranges )
+			{
+				break;
+			}
+			
+			uint32_t size;
+			size = get_size( frame );
+			
+			n_written += size;
+			
+			((read_ack_queue*) that)->acknowledge( size );
+			
+			update_progress();
+			
+			{
+				range& r = the_ranges[ id - 1 ];
+				
+				pwrite_in_full( output_fd, get_char_data( frame ), size, r.offset );
+				
+				r.offset += size;
+			}
+			
+			break;
+		
+		case Frame_result:
+			if ( const uint32_t result = get_u32( frame ) )
+			{
+				the_result = result;
+			}
+			
+			if ( ++n_ranges_done == n_ranges )
+			{
+				shutdown( protocol_out, SHUT_WR );
+				
+				end_progress();
+			}
+			
+			break;
+		
+		default:
+			write( STDERR_FILENO, STR_LEN( "Unfrag\n" ) );
+			
+			abort();
+	}
+	
+	return 0;
+}
+
 static
 const char* name_from_path( const char* path )
 {
@@ -231,35 +354,50 @@ void open_file( const char* name )
 	}
 }
 
-static inline
-void queue_request( send_queue& queue, uint8_t request_type )
-{
-	queue_int( queue, Frame_request, request_type );
-}
-
-static inline
-void queue_submit( send_queue& queue )
-{
-	queue_empty( queue, Frame_submit );
-}
-
 static
 void send_read_request( int fd, const char* path, uint32_t size, off_t offset )
 {
-	send_queue queue( fd );
-	
-	queue_request( queue, req_read );
-	
-	queue_string( queue, Frame_arg_path, path, size );
+	const arg_path path_arg( path, size );
 	
 	if ( offset != 0 )
 	{
-		queue_int( queue, Frame_seek_offset, offset );
+		typedef message< arg_path, arg_offset > read_message;
+		
+		read_message m( req_read, path_arg, arg_offset( offset ), 0 );
+		
+		m.send( fd );
+	}
+	else
+	{
+		message< arg_path > m( req_read, path_arg, 0 );
+		
+		m.send( fd );
 	}
+}
+
+static
+void send_range_requests( int fd, const char* path, uint32_t size )
+{
+	typedef message< arg_path, arg_count, arg_offset > range_message;
 	
-	queue_submit( queue );
+	const unsigned long long start = n_written;
+	const unsigned long long total = the_expected_size - start;
 	
-	queue.flush();
+	for ( int i = 0;  i < n_ranges;  ++i )
+	{
+		range& r = the_ranges[ i ];
+		
+		r.offset = start + total *  i      / n_ranges;
+		r.end    = start + total * (i + 1) / n_ranges;
+		
+		range_message m( req_read,
+		                 arg_path( path, size ),
+		                 arg_count( r.end - r.offset ),
+		                 arg_offset( r.offset ),
+		                 i + 1 );
+		
+		m.send( fd );
+	}
 }
 
 static
@@ -285,6 +423,24 @@ char* const* get_options( char* const* argv )
 				show_progress = false;
 				break;
 			
+			case Option_update:
+				updating = true;
+				break;
+			
+			case Option_ranges:
+				n_ranges = atoi( command::global_result.param );
+				
+				if ( n_ranges < 1 )
+				{
+					n_ranges = 1;
+				}
+				else if ( n_ranges > max_ranges )
+				{
+					n_ranges = max_ranges;
+				}
+				
+				break;
+			
 			default:
 				abort();
 		}
@@ -333,11 +489,101 @@ int main( int argc, char** argv )
 		return 2;  // path doesn't end with a non-slash, ergo not a file
 	}
 	
+	session_params params;
+	
+	int negotiated = negotiate( protocol_in, protocol_out, default_features(), params );
+	
+	if ( negotiated < 0 )
+	{
+		more::perror( "fget", -negotiated );
+		
+		return 1;
+	}
+	
+	if ( updating )
+	{
+		const int err = update_file( protocol_in,
+		                             protocol_out,
+		                             the_path,
+		                             name,
+		                             show_progress );
+		
+		if ( err > 0 )
+		{
+			more::perror( "fget", name, err );
+			
+			return 1;
+		}
+		
+		if ( err == 0 )
+		{
+			return 0;
+		}
+		
+		/*
+			No usable size, so fetch the whole file, replacing the old
+			copy as an update would have.
+		*/
+		
+		clobbering       = true;
+		resume_downloads = false;
+	}
+	
 	open_file( name );
 	
-	send_read_request( protocol_out, the_path, strlen( the_path ), n_written );
+	const uint32_t path_size = strlen( the_path );
+	
+	if ( n_ranges > 1 )
+	{
+		/*
+			Get the file's size first, so we can divide it into ranges.
+			If it doesn't have one, or there's too little left to fetch,
+			fall back to a single stream.
+		*/
+		
+		message< arg_path > m( req_stat, arg_path( the_path, path_size ), 0 );
+		
+		m.send( protocol_out );
+		
+		data_receiver r( &stat_frame_handler, NULL );
+		
+		int looped = run_event_loop( r, protocol_in );
+		
+		const int err = looped <  0 ? -looped
+		              : looped == 0 ? ECONNRESET
+		              :               the_result;
+		
+		if ( err )
+		{
+			more::perror( "fget", name, err );
+			
+			return 1;
+		}
+		
+		const unsigned long long n_left = the_expected_size - n_written;
+		
+		if ( the_expected_size <= n_written  ||  n_left < n_ranges * 65536ull )
+		{
+			n_ranges = 1;
+		}
+	}
+	
+	read_ack_queue acks( protocol_out, read_ack_threshold( params ) );
+	
+	frame_handler_function handler = &frame_handler;
+	
+	if ( n_ranges > 1 )
+	{
+		send_range_requests( protocol_out, the_path, path_size );
+		
+		handler = &range_frame_handler;
+	}
+	else
+	{
+		send_read_request( protocol_out, the_path, path_size, n_written );
+	}
 	
-	data_receiver r( &frame_handler, NULL );
+	data_receiver r( handler, &acks, &flush_read_acks );
 	
 	int looped = run_event_loop( r, protocol_in );
 	
@@ -0,0 +1,553 @@
+/*
+	update.cc
+	---------
+*/
+
+#include "update.hh"
+
+// POSIX
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+// Standard C++
+#include <algorithm>
+#include <vector>
+
+// Standard C
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+// plus
+#include "plus/string/concat.hh"
+
+// freemount
+#include "freemount/block_sums.hh"
+#include "freemount/event_loop.hh"
+#include "freemount/frame_size.hh"
+#include "freemount/message.hh"
+#include "freemount/receiver.hh"
+#include "freemount/send_ack.hh"
+#include "freemount/write_in_full.hh"
+
+// freemount-client
+#include "freemount/requests.hh"
+
+
+using namespace freemount;
+
+
+struct weak_entry
+{
+	uint32_t  weak;
+	uint32_t  block;
+};
+
+static inline
+bool operator<( const weak_entry& a, const weak_entry& b )
+{
+	return a.weak < b.weak;
+}
+
+struct run
+{
+	unsigned long long  offset;  // where the next data goes
+	unsigned long long  end;
+};
+
+const uint32_t block_size = default_sums_block_size;
+
+const uint32_t max_run_size = 1 << 20;  // 1 MiB per read request
+
+const int max_in_flight = 255;
+
+static unsigned long long the_size;
+static bool               has_size;
+
+static std::vector< block_sum > the_sums;
+
+static std::vector< long long > the_sources;  // offset in old file, or -1
+
+static std::vector< run > the_runs;
+
+static run* the_slots[ max_in_flight + 1 ];  // indexed by request id
+
+static size_t n_runs_sent;
+static size_t n_runs_done;
+
+static const char* the_path;
+
+static int the_output_fd;
+static int the_protocol_out;
+
+static int the_result;
+
+
+static
+int sums_handler( void* that, const frame_header& frame )
+{
+	switch ( frame.type )
+	{
+		case Frame_stat_size:
+			the_size = get_u64( frame );
+			has_size = true;
+			break;
+		
+		case Frame_block_sums:
+			{
+				const char* p = get_char_data( frame );
+				const char* end = p + get_size( frame );
+				
+				for ( ;  p + encoded_block_sum_size <= end;  p += encoded_block_sum_size )
+				{
+					block_sum sum;
+					
+					decode_block_sum( p, sum );
+					
+					the_sums.push_back( sum );
+				}
+			}
+			break;
+		
+		case Frame_result:
+			the_result = get_u32( frame );
+			return 1;
+		
+		default:
+			break;
+	}
+	
+	return 0;
+}
+
+/*
+	The size must be present and agree with the number of block sums:
+	every block but the last is full, and the last isn't empty.  If not,
+	find_blocks() and plan_runs() can't work out what to fetch.
+*/
+
+static
+bool size_matches_sums()
+{
+	const unsigned long long n_blocks = the_sums.size();
+	
+	if ( ! has_size )
+	{
+		return false;
+	}
+	
+	if ( n_blocks == 0 )
+	{
+		return the_size == 0;
+	}
+	
+	return the_size >  (n_blocks - 1) * block_size  &&
+	       the_size <=  n_blocks      * block_size;
+}
+
+static
+void find_blocks( const char* data, size_t size )
+{
+	const size_t n_blocks = the_sums.size();
+	
+	the_sources.assign( n_blocks, -1 );
+	
+	// The last block may be short; it's compared only in place.
+	
+	const size_t n_full = the_size / block_size;
+	
+	if ( n_full < n_blocks )
+	{
+		const size_t offset = n_full * block_size;
+		const size_t length = the_size - offset;
+		
+		if ( offset + length <= size  &&
+		     strong_sum( data + offset, length ) == the_sums.back().strong )
+		{
+			the_sources.back() = offset;
+		}
+	}
+	
+	if ( size < block_size  ||  n_full == 0 )
+	{
+		return;
+	}
+	
+	std::vector< weak_entry > index( n_full );
+	
+	for ( uint32_t i = 0;  i < n_full;  ++i )
+	{
+		index[ i ].weak  = the_sums[ i ].weak;
+		index[ i ].block = i;
+	}
+	
+	std::sort( index.begin(), index.end() );
+	
+	/*
+		Slide a block-sized window over the old file, a byte at a time.
+		Where its weak sum matches one of the server's blocks, confirm with
+		the strong sum, and if it's a match, skip past it.
+	*/
+	
+	size_t i = 0;
+	
+	rolling_sum sum( data, block_size );
+	
+	while ( true )
+	{
+		const weak_entry key = { sum.get(), 0 };
+		
+		typedef std::vector< weak_entry >::const_iterator Iter;
+		
+		std::pair< Iter, Iter > range = std::equal_range( index.begin(),
+		                                                  index.end(),
+		                                                  key );
+		
+		bool matched = false;
+		
+		if ( range.first != range.second )
+		{
+			const uint64_t strong = strong_sum( data + i, block_size );
+			
+			for ( Iter it = range.first;  it != range.second;  ++it )
+			{
+				if ( the_sums[ it->block ].strong == strong )
+				{
+					matched = true;
+					
+					if ( the_sources[ it->block ] < 0 )
+					{
+						the_sources[ it->block ] = i;
+					}
+				}
+			}
+		}
+		
+		if ( matched )
+		{
+			i += block_size;
+			
+			if ( i + block_size > size )
+			{
+				break;
+			}
+			
+			sum = rolling_sum( data + i, block_size );
+			
+			continue;
+		}
+		
+		if ( i + block_size >= size )
+		{
+			break;
+		}
+		
+		sum.roll( data[ i ], data[ i + block_size ] );
+		
+		++i;
+	}
+}
+
+static
+void plan_runs()
+{
+	// Coalesce consecutive missing blocks into runs of reads.
+	
+	the_runs.clear();
+	
+	for ( size_t i = 0;  i < the_sources.size();  ++i )
+	{
+		if ( the_sources[ i ] >= 0 )
+		{
+			continue;
+		}
+		
+		const unsigned long long offset = i * (unsigned long long) block_size;
+		
+		unsigned long long end = offset + block_size;
+		
+		if ( end > the_size )
+		{
+			end = the_size;
+		}
+		
+		if ( ! the_runs.empty() )
+		{
+			run& last = the_runs.back();
+			
+			if ( last.end == offset  &&  end - last.offset <= max_run_size )
+			{
+				last.end = end;
+				continue;
+			}
+		}
+		
+		const run r = { offset, end };
+		
+		the_runs.push_back( r );
+	}
+}
+
+static
+void send_next_run( uint16_t id )
+{
+	typedef message< arg_path, arg_count, arg_offset > range_message;
+	
+	run& r = the_runs[ n_runs_sent++ ];
+	
+	the_slots[ id ] = &r;
+	
+	range_message m( req_read,
+	                 arg_path( the_path, strlen( the_path ) ),
+	                 arg_count( r.end - r.offset ),
+	                 arg_offset( r.offset ),
+	                 id );
+	
+	m.send( the_protocol_out );
+}
+
+static
+int fetch_handler( void* that, const frame_header& frame )
+{
+	const uint16_t id = get_request_id( frame );
+	
+	run* r = id <= max_in_flight ? the_slots[ id ] : NULL;
+	
+	switch ( frame.type )
+	{
+		case Frame_recv_data:
+			if ( r == NULL )
+			{
+				break;
+			}
+			
+			uint32_t size;
+			size = get_size( frame );
+			
+			((read_ack_queue*) that)->acknowledge( size );
+			
+			pwrite_in_full( the_output_fd, get_data( frame ), size, r->offset );
+			
+			r->offset += size;
+			break;
+		
+		case Frame_result:
+			if ( const uint32_t result = get_u32( frame ) )
+			{
+				the_result = result;
+			}
+			
+			the_slots[ id ] = NULL;
+			
+			if ( ++n_runs_done == the_runs.size() )
+			{
+				return 1;
+			}
+			
+			if ( n_runs_sent < the_runs.size() )
+			{
+				send_next_run( id );
+			}
+			
+			break;
+		
+		default:
+			break;
+	}
+	
+	return 0;
+}
+
+static
+int fetch_runs( int in, int out )
+{
+	if ( the_runs.empty() )
+	{
+		return 0;
+	}
+	
+	the_protocol_out = out;
+	
+	for ( int id = 1;  id <= max_in_flight  &&  n_runs_sent < the_runs.size();  ++id )
+	{
+		send_next_run( id );
+	}
+	
+	read_ack_queue acks( out );
+	
+	data_receiver r( &fetch_handler, &acks, &flush_read_acks );
+	
+	const int looped = run_event_loop( r, in );
+	
+	return looped < 0  ? -looped
+	     : looped == 0 ? ECONNRESET
+	     :               the_result;
+}
+
+static
+void copy_blocks( const char* data, bool verbose )
+{
+	unsigned long long n_reused = 0;
+	
+	for ( size_t i = 0;  i < the_sources.size();  ++i )
+	{
+		const long long source = the_sources[ i ];
+		
+		if ( source < 0 )
+		{
+			continue;
+		}
+		
+		const unsigned long long offset = i * (unsigned long long) block_size;
+		
+		unsigned long long length = the_size - offset;
+		
+		if ( length > block_size )
+		{
+			length = block_size;
+		}
+		
+		pwrite_in_full( the_output_fd, data + source, length, offset );
+		
+		n_reused += length;
+	}
+	
+	if ( verbose )
+	{
+		fprintf( stderr, "fget: reused %llu of %llu bytes\n", n_reused, the_size );
+	}
+}
+
+int update_file( int in, int out, const char* path, const char* name, bool verbose )
+{
+	the_path = path;
+	
+	send_sums_request( out, path, strlen( path ), block_size );
+	
+	{
+		data_receiver r( &sums_handler, NULL );
+		
+		const int looped = run_event_loop( r, in );
+		
+		const int err = looped <  0 ? -looped
+		              : looped == 0 ? ECONNRESET
+		              :               the_result;
+		
+		if ( err )
+		{
+			return err;
+		}
+	}
+	
+	if ( ! size_matches_sums() )
+	{
+		return -1;
+	}
+	
+	// Map the old file, if there is one.
+	
+	const char* data = NULL;
+	
+	struct stat st;
+	
+	int old_fd = open( name, O_RDONLY );
+	
+	if ( old_fd >= 0 )
+	{
+		if ( fstat( old_fd, &st ) < 0 )
+		{
+			const int err = errno;
+			
+			close( old_fd );
+			
+			return err;
+		}
+		
+		if ( st.st_size > 0 )
+		{
+			void* p = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, old_fd, 0 );
+			
+			if ( p != MAP_FAILED )
+			{
+				data = (const char*) p;
+			}
+		}
+	}
+	else if ( errno != ENOENT )
+	{
+		return errno;
+	}
+	
+	find_blocks( data, data ? st.st_size : 0 );
+	
+	plan_runs();
+	
+	const plus::string temp_name = plus::concat( name, ".fget-update" );
+	
+	the_output_fd = open( temp_name.c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0666 );
+	
+	if ( the_output_fd < 0 )
+	{
+		return errno;
+	}
+	
+	int err = 0;
+	
+	try
+	{
+		if ( data )
+		{
+			copy_blocks( data, verbose );
+		}
+		
+		err = fetch_runs( in, out );
+	}
+	catch ( const failed_write& failure )
+	{
+		err = failure.errnum;
+	}
+	
+	shutdown( out, SHUT_WR );
+	
+	if ( data )
+	{
+		munmap( (void*) data, st.st_size );
+	}
+	
+	if ( old_fd >= 0 )
+	{
+		close( old_fd );
+	}
+	
+	if ( err == 0  &&  ftruncate( the_output_fd, the_size ) < 0 )
+	{
+		err = errno;
+	}
+	
+	// The new file replaces the old one, so give it the old one's mode.
+	
+	if ( err == 0  &&  old_fd >= 0  &&  fchmod( the_output_fd, st.st_mode & 07777 ) < 0 )
+	{
+		err = errno;
+	}
+	
+	if ( close( the_output_fd ) < 0  &&  err == 0 )
+	{
+		err = errno;
+	}
+	
+	if ( err == 0  &&  rename( temp_name.c_str(), name ) < 0 )
+	{
+		err = errno;
+	}
+	
+	if ( err )
+	{
+		unlink( temp_name.c_str() );
+	}
+	
+	return err;
+}
@@ -0,0 +1,26 @@
+/*
+	update.hh
+	---------
+*/
+
+#ifndef UPDATE_HH
+#define UPDATE_HH
+
+/*
+	update_file() brings the local file name up to date with the server's
+	file at path.  It gets the server's block sums, finds the blocks the
+	local copy already has (at any offset), and fetches only the rest,
+	assembling the result in a temporary file that then replaces name,
+	with the same mode.  It returns zero or an errno value -- or -1, if
+	the server's size is missing or disagrees with its sums, in which case
+	name is untouched and the caller should fetch the whole file instead.
+	If verbose is set, it reports how many bytes were reused.
+*/
+
+int update_file( int          in,
+                 int          out,
+                 const char*  path,
+                 const char*  name,
+                 bool         verbose );
+
+#endif
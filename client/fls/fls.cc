@@ -31,6 +31,7 @@
 #include "freemount/event_loop.hh"
 #include "freemount/frame_size.hh"
 #include "freemount/receiver.hh"
+#include "freemount/send_queue.hh"
 
 // freemount-client
 #include "freemount/address.hh"
@@ -48,6 +49,14 @@ static unet::connection_box the_connection;
 static int protocol_in  = -1;
 static int protocol_out = -1;
 
+/*
+	Requests are queued, and the queue is flushed at the end of each batch
+	of incoming frames, so a directory's worth of stat requests goes out in
+	a few large writes rather than one small write per entry.
+*/
+
+static send_queue* the_queue;
+
 
 static plus::string the_path = "/";
 
@@ -202,13 +211,21 @@ void send_stat_request( const plus::string& path, uint8_t r_id )
 	st.nlink = 1;
 	st.size = 0;
 	
-	send_stat_request( protocol_out, path.data(), path.size(), r_id );
+	send_stat_request( *the_queue, path.data(), path.size(), r_id );
 }
 
 static
 void send_list_request( const plus::string& path, uint8_t r_id )
 {
-	send_list_request( protocol_out, path.data(), path.size(), r_id );
+	send_list_request( *the_queue, path.data(), path.size(), r_id );
+}
+
+static
+void hang_up()
+{
+	the_queue->flush();
+	
+	shutdown( protocol_out, SHUT_WR );
 }
 
 static
@@ -275,7 +292,7 @@ int frame_handler( void* that, const frame_header& frame )
 				{
 					the_result = err;
 					
-					shutdown( protocol_out, SHUT_WR );
+					hang_up();
 					
 					break;
 				}
@@ -299,7 +316,7 @@ int frame_handler( void* that, const frame_header& frame )
 					
 					if ( the_stats.empty() )
 					{
-						shutdown( protocol_out, SHUT_WR );
+						hang_up();
 					}
 				}
 				
@@ -341,7 +358,7 @@ int frame_handler( void* that, const frame_header& frame )
 			
 			if ( the_result != 0  ||  the_stats.empty() )
 			{
-				shutdown( protocol_out, SHUT_WR );
+				hang_up();
 			}
 			break;
 		
@@ -354,6 +371,14 @@ int frame_handler( void* that, const frame_header& frame )
 	return 0;
 }
 
+static
+int batch_end( void* that )
+{
+	the_queue->flush();
+	
+	return 0;
+}
+
 int main( int argc, char** argv )
 {
 	char* address = argv[ argc > 0 ];
@@ -377,9 +402,15 @@ int main( int argc, char** argv )
 		the_path.assign( path, strlen( path ), vxo::delete_never );
 	}
 	
+	send_queue queue( protocol_out );
+	
+	the_queue = &queue;
+	
 	send_stat_request( the_path, 0 );
 	
-	data_receiver r( &frame_handler, NULL );
+	queue.flush();
+	
+	data_receiver r( &frame_handler, NULL, &batch_end );
 	
 	int looped = run_event_loop( r, protocol_in );
 	
@@ -0,0 +1,713 @@
+/*
+	fmagent.cc
+	----------
+*/
+
+// POSIX
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+// Standard C
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Standard C++
+#include <deque>
+#include <map>
+#include <vector>
+
+// more-posix
+#include "more/perror.hh"
+
+// unet-connect
+#include "unet/connect.hh"
+
+// freemount
+#include "freemount/event_loop.hh"
+#include "freemount/frame_size.hh"
+#include "freemount/queue_utils.hh"
+#include "freemount/receiver.hh"
+#include "freemount/send_ack.hh"
+#include "freemount/send_queue.hh"
+#include "freemount/write_in_full.hh"
+
+// freemount-client
+#include "freemount/address.hh"
+#include "freemount/agent.hh"
+#include "freemount/negotiate.hh"
+
+
+#define PROGRAM  "fmagent"
+
+#define USAGE  "usage: " PROGRAM " <Freemount address>\n"
+
+#define STR_LEN( s )  "" s, (sizeof s - 1)
+
+
+using namespace freemount;
+
+
+/*
+	fmagent holds one session with a server and multiplexes the sessions
+	of its clients onto it.  Every request a client begins is assigned a
+	request id of the agent's own for the upstream session, and frames are
+	relabeled in each direction.  (Clients' r_id 0 requests are remapped
+	like any other, so synchronous tools can share the session too.)
+	
+	Clients aren't offered vers -- their pings are answered as by a server
+	that predates it -- so they use the base protocol, which keeps frames
+	valid as they pass through unchanged.  Upstream, the agent negotiates
+	wide ids, if it can, for room to keep many clients' requests in flight.
+	
+	Clients' sockets are non-blocking, and each client has its own output
+	buffer, so one that stops reading can't stall the others.  The agent
+	acknowledges the server's data itself, once it's been written to the
+	client, so a client that quits mid-read can't stall the congestion
+	window.  A client whose unwritten output exceeds half the window (so
+	that it would stall the others soon enough) is dropped.
+*/
+
+struct client;
+
+struct route
+{
+	client*   owner;  // NULL once the client is gone
+	uint16_t  r_id;   // the client's id for the request
+	uint8_t   type;
+	bool      submitted;
+	bool      in_use;
+};
+
+struct pending_ack
+{
+	uint64_t  end;     // where the data ends in the client's output
+	uint32_t  n_data;  // the number of bytes to acknowledge
+};
+
+struct client
+{
+	int            fd;
+	bool           broken;
+	data_receiver  receiver;
+	
+	std::vector< char >  output;     // queued frames not yet written
+	uint64_t             n_queued;   // all bytes ever queued
+	uint64_t             n_written;  // all bytes ever written
+	
+	std::deque< pending_ack > acks;  // data written to us but not to the client
+	
+	std::map< uint16_t, uint16_t > upstream_ids;  // client's -> ours
+	
+	client( int fd );
+};
+
+static unet::connection_box the_connection;
+
+static int protocol_in  = -1;
+static int protocol_out = -1;
+
+static send_queue*      the_upstream;
+static read_ack_queue*  the_acks;
+
+static std::vector< client* > the_clients;
+static std::vector< route >   the_routes;
+
+static uint16_t the_max_id  = 0xFF;
+static uint16_t the_last_id = 0;
+
+static size_t the_max_backlog = 8 * 1024 * 1024;  // if there's no window
+
+
+static
+void queue_frame( send_queue& queue, const frame_header& frame, uint16_t r_id )
+{
+	frame_header header = frame;
+	
+	set_request_id( header, r_id );
+	
+	queue.reserve( get_frame_size( frame ) );
+	
+	queue.add( &header, sizeof header );
+	
+	if ( has_payload( frame ) )
+	{
+		const uint32_t size = get_frame_size( frame ) - sizeof header;
+		
+		queue.add( get_payload_data( frame ), size );
+	}
+}
+
+static
+void forward( client& c, const frame_header& frame, uint16_t r_id )
+{
+	if ( c.broken )
+	{
+		return;
+	}
+	
+	frame_header header = frame;
+	
+	set_request_id( header, r_id );
+	
+	const char* begin = (const char*) &header;
+	
+	c.output.insert( c.output.end(), begin, begin + sizeof header );
+	
+	const uint32_t size = get_frame_size( frame ) - sizeof header;
+	
+	begin = (const char*) get_payload_data( frame );
+	
+	c.output.insert( c.output.end(), begin, begin + size );
+	
+	c.n_queued += sizeof header + size;
+	
+	if ( c.output.size() > the_max_backlog )
+	{
+		c.broken = true;  // It's stopped reading; don't let it stall the rest.
+	}
+}
+
+static
+void acknowledge_written( client& c )
+{
+	while ( ! c.acks.empty()  &&  c.acks.front().end <= c.n_written )
+	{
+		the_acks->acknowledge( c.acks.front().n_data );
+		
+		c.acks.pop_front();
+	}
+}
+
+static
+void flush( client& c )
+{
+	if ( c.broken  ||  c.output.empty() )
+	{
+		return;
+	}
+	
+	const ssize_t n = write( c.fd, &c.output[ 0 ], c.output.size() );
+	
+	if ( n < 0 )
+	{
+		if ( errno != EAGAIN  &&  errno != EINTR )
+		{
+			c.broken = true;
+		}
+		
+		return;
+	}
+	
+	c.output.erase( c.output.begin(), c.output.begin() + n );
+	
+	c.n_written += n;
+	
+	acknowledge_written( c );
+}
+
+static
+uint16_t allocate_id( client& c, uint16_t r_id, uint8_t type )
+{
+	for ( unsigned i = 0;  i < the_max_id;  ++i )
+	{
+		the_last_id = the_last_id % the_max_id + 1;  // never 0
+		
+		route& r = the_routes[ the_last_id ];
+		
+		if ( ! r.in_use )
+		{
+			r.owner     = &c;
+			r.r_id      = r_id;
+			r.type      = type;
+			r.submitted = false;
+			r.in_use    = true;
+			
+			return the_last_id;
+		}
+	}
+	
+	return 0;
+}
+
+static
+int client_frame_handler( void* that, const frame_header& frame )
+{
+	client& c = *(client*) that;
+	
+	switch ( frame.type )
+	{
+		case Frame_fatal:
+		case Frame_error:
+		case Frame_debug:
+			return 0;
+		
+		case Frame_ping:
+			{
+				frame_header pong = FREEMOUNT_FRAME_HEADER_INITIALIZER;
+				
+				pong.type = Frame_pong;  // with no vers
+				
+				forward( c, pong, 0 );
+			}
+			return 0;
+		
+		case Frame_ack_read:
+			return 0;  // We've acked the data already.
+		
+		default:
+			break;
+	}
+	
+	if ( frame.type >= Frame_accept )
+	{
+		return -EINVAL;  // not a request frame
+	}
+	
+	typedef std::map< uint16_t, uint16_t >::const_iterator Iter;
+	
+	const uint16_t r_id = get_request_id( frame );
+	
+	const Iter it = c.upstream_ids.find( r_id );
+	
+	if ( frame.type == Frame_request )
+	{
+		if ( it != c.upstream_ids.end()  ||  frame.data == req_vers )
+		{
+			return -EINVAL;
+		}
+		
+		const uint16_t id = allocate_id( c, r_id, frame.data );
+		
+		if ( id == 0 )
+		{
+			return -ENOBUFS;  // all our ids are in use
+		}
+		
+		c.upstream_ids[ r_id ] = id;
+		
+		queue_frame( *the_upstream, frame, id );
+		
+		return 0;
+	}
+	
+	if ( it == c.upstream_ids.end() )
+	{
+		return -ESRCH;
+	}
+	
+	if ( frame.type == Frame_submit )
+	{
+		the_routes[ it->second ].submitted = true;
+	}
+	
+	queue_frame( *the_upstream, frame, it->second );
+	
+	return 0;
+}
+
+static
+int client_batch_end( void* that )
+{
+	client& c = *(client*) that;
+	
+	flush( c );
+	
+	the_upstream->flush();
+	
+	return 0;
+}
+
+client::client( int fd )
+:
+	fd( fd ),
+	broken(),
+	receiver( &client_frame_handler, this, &client_batch_end ),
+	n_queued(),
+	n_written()
+{
+}
+
+static
+int server_frame_handler( void* that, const frame_header& frame )
+{
+	switch ( frame.type )
+	{
+		case Frame_fatal:
+			write( STDERR_FILENO, STR_LEN( "[FATAL]: " ) );
+			write( STDERR_FILENO, get_char_data( frame ), get_size( frame ) );
+			write( STDERR_FILENO, STR_LEN( "\n" ) );
+			return 0;
+		
+		case Frame_error:
+			write( STDERR_FILENO, STR_LEN( "[ERROR]: " ) );
+			write( STDERR_FILENO, get_char_data( frame ), get_size( frame ) );
+			write( STDERR_FILENO, STR_LEN( "\n" ) );
+			return 0;
+		
+		case Frame_debug:
+			write( STDERR_FILENO, STR_LEN( "[DEBUG]: " ) );
+			write( STDERR_FILENO, get_char_data( frame ), get_size( frame ) );
+			write( STDERR_FILENO, STR_LEN( "\n" ) );
+			return 0;
+		
+		case Frame_pong:
+			return 0;
+		
+		default:
+			break;
+	}
+	
+	const uint16_t r_id = get_request_id( frame );
+	
+	if ( r_id > the_max_id  ||  ! the_routes[ r_id ].in_use )
+	{
+		return 0;
+	}
+	
+	route& r = the_routes[ r_id ];
+	
+	client* c = r.owner;
+	
+	if ( c  &&  ! c->broken )
+	{
+		forward( *c, frame, r.r_id );
+		
+		if ( frame.type == Frame_recv_data )
+		{
+			// Acknowledge the data once it's been written to the client.
+			
+			const pending_ack ack = { c->n_queued, get_size( frame ) };
+			
+			c->acks.push_back( ack );
+		}
+	}
+	else if ( frame.type == Frame_recv_data )
+	{
+		the_acks->acknowledge( get_size( frame ) );
+	}
+	
+	/*
+		The server sends exactly one result per request, even one that's
+		cancelled, so a cancelled id stays reserved until its result.
+	*/
+	
+	if ( frame.type == Frame_result )
+	{
+		if ( r.owner )
+		{
+			r.owner->upstream_ids.erase( r.r_id );
+		}
+		
+		r.in_use = false;
+	}
+	
+	return 0;
+}
+
+static
+int server_batch_end( void* that )
+{
+	for ( size_t i = 0;  i < the_clients.size();  ++i )
+	{
+		flush( *the_clients[ i ] );
+	}
+	
+	the_acks->flush();
+	
+	return 0;
+}
+
+static inline
+bool is_task( uint8_t type )
+{
+	return type == req_read  ||  type == req_sums  ||  type == req_watch;
+}
+
+static
+void drop_client( size_t i )
+{
+	client* c = the_clients[ i ];
+	
+	// Its unwritten data is discarded, so acknowledge it now.
+	
+	c->n_written = c->n_queued;
+	
+	acknowledge_written( *c );
+	
+	the_acks->flush();
+	
+	typedef std::map< uint16_t, uint16_t >::const_iterator Iter;
+	
+	for ( Iter it = c->upstream_ids.begin();  it != c->upstream_ids.end();  ++it )
+	{
+		const uint16_t id = it->second;
+		
+		route& r = the_routes[ id ];
+		
+		r.owner = NULL;
+		
+		/*
+			The server answers other requests as soon as they're submitted,
+			so those results are on their way and will free the id.  Cancel
+			the rest, or they'd hold the id (and in a task's case, the server
+			thread) indefinitely.
+		*/
+		
+		if ( ! r.submitted  ||  is_task( r.type ) )
+		{
+			queue_empty( *the_upstream, Frame_cancel, id );
+		}
+	}
+	
+	the_upstream->flush();
+	
+	close( c->fd );
+	
+	delete c;
+	
+	the_clients.erase( the_clients.begin() + i );
+}
+
+static
+int listen_on( const sockaddr_un& un )
+{
+	int fd = socket( PF_UNIX, SOCK_STREAM, 0 );
+	
+	if ( fd < 0 )
+	{
+		return -1;
+	}
+	
+	unlink( un.sun_path );  // left over from an agent that exited
+	
+	if ( bind( fd, (const sockaddr*) &un, sizeof un ) < 0  ||  listen( fd, 16 ) < 0 )
+	{
+		close( fd );
+		return -1;
+	}
+	
+	return fd;
+}
+
+static
+int run( int listener )
+{
+	data_receiver r( &server_frame_handler, NULL, &server_batch_end );
+	
+	std::vector< pollfd > fds;
+	
+	for ( ;; )
+	{
+		const pollfd listener_pfd = { listener,    POLLIN, 0 };
+		const pollfd server_pfd   = { protocol_in, POLLIN, 0 };
+		
+		fds.clear();
+		
+		fds.push_back( listener_pfd );
+		fds.push_back( server_pfd   );
+		
+		for ( size_t i = 0;  i < the_clients.size();  ++i )
+		{
+			const client& c = *the_clients[ i ];
+			
+			const short events = c.output.empty() ? POLLIN : POLLIN | POLLOUT;
+			
+			const pollfd client_pfd = { c.fd, events, 0 };
+			
+			fds.push_back( client_pfd );
+		}
+		
+		if ( poll( &fds[ 0 ], fds.size(), -1 ) < 0 )
+		{
+			if ( errno == EINTR )
+			{
+				continue;
+			}
+			
+			return -errno;
+		}
+		
+		if ( fds[ 1 ].revents )
+		{
+			if ( int status = receive_batch( r, protocol_in ) )
+			{
+				return status == -ECONNRESET ? 0 : status;
+			}
+		}
+		
+		for ( size_t i = 2;  i < fds.size();  ++i )
+		{
+			const short revents = fds[ i ].revents;
+			
+			client& c = *the_clients[ i - 2 ];
+			
+			if ( revents & POLLOUT )
+			{
+				flush( c );
+			}
+			
+			if ( revents & ~POLLOUT )
+			{
+				try
+				{
+					const int status = receive_batch( c.receiver, c.fd );
+					
+					if ( status != 0  &&  status != -EAGAIN )
+					{
+						c.broken = true;
+					}
+				}
+				catch ( const failed_write& )
+				{
+					c.broken = true;
+				}
+			}
+		}
+		
+		the_acks->flush();
+		
+		for ( size_t i = the_clients.size();  i > 0;  --i )
+		{
+			if ( the_clients[ i - 1 ]->broken )
+			{
+				drop_client( i - 1 );
+			}
+		}
+		
+		if ( fds[ 0 ].revents & POLLIN )
+		{
+			int fd = accept( listener, NULL, NULL );
+			
+			if ( fd >= 0 )
+			{
+				fcntl( fd, F_SETFL, fcntl( fd, F_GETFL ) | O_NONBLOCK );
+				
+				the_clients.push_back( new client( fd ) );
+			}
+		}
+	}
+}
+
+int main( int argc, char** argv )
+{
+	if ( argc < 2 )
+	{
+		write( STDERR_FILENO, STR_LEN( USAGE ) );
+		return 2;
+	}
+	
+	// Connect to the server itself, not to another agent.
+	
+	setenv( "FREEMOUNT_NO_AGENT", "1", 1 );
+	
+	const char** connector_argv = parse_address( argv[ 1 ] );
+	
+	if ( connector_argv == NULL )
+	{
+		write( STDERR_FILENO, STR_LEN( PROGRAM ": malformed address\n" ) );
+		return 2;
+	}
+	
+	const char* dir = agent_socket_dir();
+	
+	if ( dir == NULL )
+	{
+		more::perror( PROGRAM, "TMPDIR", ENAMETOOLONG );
+		return 1;
+	}
+	
+	if ( mkdir( dir, 0700 ) < 0  &&  errno != EEXIST )
+	{
+		more::perror( PROGRAM, dir, errno );
+		return 1;
+	}
+	
+	if ( ! agent_dir_is_private( dir ) )
+	{
+		more::perror( PROGRAM, dir, EPERM );
+		return 1;
+	}
+	
+	sockaddr_un un = { 0 };
+	
+	un.sun_family = AF_UNIX;
+	
+	strcpy( un.sun_path, agent_socket_path( connector_argv ) );
+	
+	if ( agent_is_running( un.sun_path ) )
+	{
+		more::perror( PROGRAM, un.sun_path, EADDRINUSE );
+		return 1;
+	}
+	
+	signal( SIGPIPE, SIG_IGN );
+	
+	the_connection = unet::connect( connector_argv );
+	
+	protocol_in  = the_connection.get_input ();
+	protocol_out = the_connection.get_output();
+	
+	session_params params;
+	
+	if ( int nok = negotiate( protocol_in, protocol_out, Feature_wide_ids, params ) )
+	{
+		more::perror( PROGRAM, -nok );
+		return 1;
+	}
+	
+	if ( params.features & Feature_wide_ids )
+	{
+		the_max_id = 0xFFFF;
+	}
+	
+	the_routes.resize( the_max_id + 1u );
+	
+	if ( params.window )
+	{
+		the_max_backlog = params.window / 2;
+	}
+	
+	send_queue     upstream( protocol_out );
+	read_ack_queue acks( protocol_out, read_ack_threshold( params ) );
+	
+	the_upstream = &upstream;
+	the_acks     = &acks;
+	
+	int listener = listen_on( un );
+	
+	if ( listener < 0 )
+	{
+		more::perror( PROGRAM, un.sun_path, errno );
+		return 1;
+	}
+	
+	write( STDOUT_FILENO, un.sun_path, strlen( un.sun_path ) );
+	write( STDOUT_FILENO, STR_LEN( "\n" ) );
+	
+	int status;
+	
+	try
+	{
+		status = run( listener );
+	}
+	catch ( const failed_write& e )
+	{
+		status = -e.errnum;
+	}
+	
+	unlink( un.sun_path );
+	
+	if ( status < 0 )
+	{
+		more::perror( PROGRAM, -status );
+		return 1;
+	}
+	
+	return 0;
+}
@@ -89,6 +89,8 @@ int main( int argc, char** argv )
 	
 	try
 	{
+		synced_batch batch( protocol_in, protocol_out );
+		
 		int lock_fd   = OPEN( TEST_PORT "/lock"   );
 		int window_fd = OPEN( TEST_PORT "/window" );
 		
@@ -99,6 +101,8 @@ int main( int argc, char** argv )
 		
 		PUT( TEST_PORT "/v/padding", "4"           "\n" );
 		PUT( TEST_PORT "/v/v/text",  "Hello world" "\n" );
+		
+		batch.finish();
 	}
 	catch ( const path_error& e )
 	{
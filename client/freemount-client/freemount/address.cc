@@ -6,8 +6,12 @@
 #include "freemount/address.hh"
 
 // Standard C
+#include <stdlib.h>
 #include <string.h>
 
+// freemount-client
+#include "freemount/agent.hh"
+
 
 #define STR_LEN( s )  "" s, (sizeof s - 1)
 
@@ -116,7 +120,8 @@ namespace freemount
 		return ussh_argv + 1;
 	}
 	
-	const char** parse_address( char* address )
+	static
+	const char** parse_server_address( char* address )
 	{
 		// null -> uexec
 		
@@ -203,4 +208,47 @@ namespace freemount
 		return parse_ssh_path( p );
 	}
 	
+	static
+	const char** prefer_agent( const char** argv )
+	{
+		/*
+			Local sockets and stdio are already cheap to connect to.
+			A uexec server serves the current directory, which its argv
+			doesn't capture, so an agent for it would serve the wrong tree.
+		*/
+		
+		if ( argv == uunix_argv + 1  ||  argv == null_argv + 1 )
+		{
+			return argv;
+		}
+		
+		if ( argv == uexec_argv + 1 )
+		{
+			return argv;
+		}
+		
+		if ( getenv( "FREEMOUNT_NO_AGENT" ) )
+		{
+			return argv;
+		}
+		
+		const char* socket = agent_socket_path( argv );
+		
+		if ( socket == NULL  ||  ! agent_is_running( socket ) )
+		{
+			return argv;
+		}
+		
+		// Keep the path within the server.
+		
+		return make_unix_connector( socket, argv[ -1 ] );
+	}
+	
+	const char** parse_address( char* address )
+	{
+		const char** argv = parse_server_address( address );
+		
+		return argv ? prefer_agent( argv ) : NULL;
+	}
+	
 }
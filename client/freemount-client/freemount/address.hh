@@ -23,6 +23,8 @@ namespace freemount
 		         The result structure may reference the input string, and is
 		         therefore only valid as long as the input string is in scope
 		         (which is the entire life of the process for argv data).
+		         If an fmagent is serving the same server, the result
+		         connects to it instead, with the same path (see agent.hh).
 		         
 	*/
 	
@@ -0,0 +1,195 @@
+/*
+	freemount/agent.cc
+	------------------
+*/
+
+#include "freemount/agent.hh"
+
+// POSIX
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+// Standard C
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+namespace freemount
+{
+	
+	static char the_socket_path[ sizeof (sockaddr_un) ];
+	
+	static
+	char* append_hex( char* p, uint64_t x, int n_digits )
+	{
+		const char* hex = "0123456789abcdef";
+		
+		for ( int i = n_digits - 1;  i >= 0;  --i )
+		{
+			p[ i ] = hex[ x & 0xF ];
+			
+			x >>= 4;
+		}
+		
+		return p + n_digits;
+	}
+	
+	static
+	uint64_t hash_argv( const char* const* argv )
+	{
+		/*
+			64-bit FNV-1a, including each argument's terminating NUL.
+			The prime is 2^40 + 0x1b3.
+		*/
+		
+		uint64_t hash = uint64_t( 0xcbf29ce4 ) << 32 | 0x84222325;
+		
+		while ( const char* arg = *argv++ )
+		{
+			do
+			{
+				hash ^= uint8_t( *arg );
+				hash = (hash << 40) + hash * 0x1b3;
+			}
+			while ( *arg++ != '\0' );
+		}
+		
+		return hash;
+	}
+	
+	const char* agent_socket_dir()
+	{
+		const char* tmp = getenv( "TMPDIR" );
+		
+		if ( tmp == NULL  ||  *tmp == '\0' )
+		{
+			tmp = "/tmp";
+		}
+		
+		const size_t tmp_size = strlen( tmp );
+		
+		const size_t max_size = sizeof the_socket_path - sizeof "/freemount-12345678/0123456789abcdef";
+		
+		if ( tmp_size > max_size )
+		{
+			return NULL;
+		}
+		
+		char* p = the_socket_path;
+		
+		memcpy( p, tmp, tmp_size );
+		
+		p += tmp_size;
+		
+		memcpy( p, "/freemount-", 11 );
+		
+		p += 11;
+		
+		p = append_hex( p, getuid(), 8 );
+		
+		*p = '\0';
+		
+		return the_socket_path;
+	}
+	
+	const char* agent_socket_path( const char* const* connector_argv )
+	{
+		if ( agent_socket_dir() == NULL )
+		{
+			return NULL;
+		}
+		
+		char* p = the_socket_path + strlen( the_socket_path );
+		
+		*p++ = '/';
+		
+		p = append_hex( p, hash_argv( connector_argv ), 16 );
+		
+		*p = '\0';
+		
+		return the_socket_path;
+	}
+	
+	bool agent_dir_is_private( const char* dir )
+	{
+		struct stat st;
+		
+		return lstat( dir, &st ) == 0  &&  S_ISDIR( st.st_mode )
+		                               &&  st.st_uid == getuid()
+		                               &&  (st.st_mode & 077) == 0;
+	}
+	
+	bool agent_is_running( const char* socket_path )
+	{
+		sockaddr_un un = { 0 };
+		
+		un.sun_family = AF_UNIX;
+		
+		const size_t size = strlen( socket_path );
+		
+		const char* slash = strrchr( socket_path, '/' );
+		
+		if ( size >= sizeof un.sun_path  ||  slash == NULL )
+		{
+			return false;
+		}
+		
+		/*
+			Another user could create our socket directory before we do, and
+			plant an agent of their own in it, so trust only our own socket
+			in a directory that only we can write.
+		*/
+		
+		memcpy( un.sun_path, socket_path, slash - socket_path );
+		
+		if ( ! agent_dir_is_private( un.sun_path ) )
+		{
+			return false;
+		}
+		
+		memcpy( un.sun_path, socket_path, size );
+		
+		struct stat st;
+		
+		if ( lstat( socket_path, &st ) < 0 )
+		{
+			return false;
+		}
+		
+		if ( ! S_ISSOCK( st.st_mode )  ||  st.st_uid != getuid() )
+		{
+			return false;
+		}
+		
+		int fd = socket( PF_UNIX, SOCK_STREAM, 0 );
+		
+		if ( fd < 0 )
+		{
+			return false;
+		}
+		
+		bool running = connect( fd, (const sockaddr*) &un, sizeof un ) == 0;
+		
+#ifdef SO_PEERCRED
+		
+		if ( running )
+		{
+			ucred cred;
+			
+			socklen_t len = sizeof cred;
+			
+			running = getsockopt( fd, SOL_SOCKET, SO_PEERCRED, &cred, &len ) == 0
+			          &&  cred.uid == getuid();
+		}
+		
+#endif
+		
+		close( fd );
+		
+		return running;
+	}
+	
+}
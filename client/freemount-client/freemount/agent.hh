@@ -0,0 +1,46 @@
+/*
+	freemount/agent.hh
+	------------------
+*/
+
+#ifndef FREEMOUNT_AGENT_HH
+#define FREEMOUNT_AGENT_HH
+
+
+namespace freemount
+{
+	
+	/*
+		fmagent keeps one session open to a server and lets client tools
+		share it through a Unix-domain socket, sparing each of them the cost
+		of starting a connector and a server of its own.
+		
+		An agent is identified by the connector argv that parse_address()
+		yields, so every address that leads to the same server (regardless
+		of the path within it) finds the same agent.  agent_socket_path()
+		returns the socket's path in a static buffer:
+		
+			${TMPDIR:-/tmp}/freemount-<uid>/<hash of argv>
+		
+		agent_is_running() checks whether something accepts connections at
+		the given socket path, so a socket left behind by an agent that has
+		since exited doesn't count.  It trusts only a socket that we own, in
+		a directory that we own and that no one else can access (as checked
+		by agent_dir_is_private()), and where the system reports the peer's
+		credentials, only an agent running as us.
+		
+		parse_address() prefers a running agent unless FREEMOUNT_NO_AGENT is
+		set in the environment.  (fmagent sets it for itself.)
+	*/
+	
+	const char* agent_socket_dir();
+	
+	const char* agent_socket_path( const char* const* connector_argv );
+	
+	bool agent_dir_is_private( const char* dir );
+	
+	bool agent_is_running( const char* socket_path );
+	
+}
+
+#endif
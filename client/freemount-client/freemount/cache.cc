@@ -0,0 +1,426 @@
+/*
+	freemount/cache.cc
+	------------------
+*/
+
+#include "freemount/cache.hh"
+
+// POSIX
+#include <sys/time.h>
+
+// Standard C
+#include <errno.h>
+
+// plus
+#include "plus/var_string.hh"
+
+// freemount
+#include "freemount/event_loop.hh"
+#include "freemount/frame_size.hh"
+#include "freemount/negotiate.hh"
+#include "freemount/receiver.hh"
+#include "freemount/requests.hh"
+#include "freemount/send_ack.hh"
+
+
+namespace freemount
+{
+	
+	static
+	uint64_t now_ms()
+	{
+		timeval tv;
+		
+		gettimeofday( &tv, NULL );
+		
+		return uint64_t( tv.tv_sec ) * 1000 + tv.tv_usec / 1000;
+	}
+	
+	/*
+		A fetch collects the responses to a stat request (with stat_id) and
+		a read or list request (with body_id), sent together.
+	*/
+	
+	enum
+	{
+		stat_id = 1,
+		body_id = 2,
+	};
+	
+	struct fetch
+	{
+		read_ack_queue    acks;
+		file_attrs        attrs;
+		int32_t           stat_result;
+		int32_t           body_result;
+		plus::var_string  data;
+		
+		std::vector< plus::string > names;
+		
+		int n_pending;
+		
+		fetch( int fd, int n ) : acks( fd ), attrs(), n_pending( n )
+		{
+			stat_result = -1;
+			body_result = -1;
+		}
+	};
+	
+	static
+	int fetch_handler( void* that, const frame_header& frame )
+	{
+		fetch& f = *(fetch*) that;
+		
+		const bool for_stat = get_request_id( frame ) == stat_id;
+		
+		switch ( frame.type )
+		{
+			case Frame_stat_mode:
+				f.attrs.mode = get_u32( frame );
+				break;
+			
+			case Frame_stat_nlink:
+				f.attrs.nlink = get_u32( frame );
+				break;
+			
+			case Frame_stat_size:
+				if ( for_stat )
+				{
+					f.attrs.size = get_u64( frame );
+				}
+				else
+				{
+					f.data.reserve( get_u64( frame ) );
+				}
+				
+				break;
+			
+			case Frame_stat_mtime:
+				f.attrs.mtime = get_u64( frame );
+				break;
+			
+			case Frame_recv_data:
+				f.acks.acknowledge( get_size( frame ) );
+				
+				f.data.append( get_char_data( frame ), get_size( frame ) );
+				break;
+			
+			case Frame_dentry_name:
+				f.names.push_back( plus::string( get_char_data( frame ),
+				                                 get_size( frame ) ) );
+				break;
+			
+			case Frame_result:
+				(for_stat ? f.stat_result : f.body_result) = get_u32( frame );
+				
+				return --f.n_pending == 0;
+			
+			default:
+				break;
+		}
+		
+		return 0;
+	}
+	
+	static
+	int fetch_batch_end( void* that )
+	{
+		fetch& f = *(fetch*) that;
+		
+		f.acks.flush();
+		
+		return 0;
+	}
+	
+	static
+	void run_fetch( fetch& f, int in, const plus::string& path )
+	{
+		data_receiver r( &fetch_handler, &f, &fetch_batch_end );
+		
+		const int looped = run_event_loop( r, in );
+		
+		if ( looped <= 0 )
+		{
+			throw connection_error( path, looped < 0 ? -looped : ECONNRESET );
+		}
+	}
+	
+	
+	client_cache::client_cache( size_t budget, unsigned ttl_ms )
+	:
+		its_budget( budget ),
+		its_total(),
+		its_ttl( ttl_ms ),
+		its_negotiated()
+	{
+	}
+	
+	int client_cache::negotiate( int in, int out, uint32_t features )
+	{
+		session_params params;
+		
+		features |= Feature_stat_mtime;
+		
+		if ( int nok = freemount::negotiate( in, out, features, params ) )
+		{
+			return nok;
+		}
+		
+		its_negotiated = true;
+		
+		return params.features;
+	}
+	
+	void client_cache::prepare( int in, int out, const plus::string& path )
+	{
+		if ( ! its_negotiated )
+		{
+			const int granted = negotiate( in, out );
+			
+			if ( granted < 0 )
+			{
+				throw connection_error( path, -granted );
+			}
+		}
+	}
+	
+	client_cache::entry& client_cache::touch( const plus::string& path )
+	{
+		entry_map::iterator it = its_entries.find( path );
+		
+		if ( it == its_entries.end() )
+		{
+			entry& e = its_entries[ path ];
+			
+			e.attrs      = file_attrs();
+			e.attrs_time = 0;
+			e.names_time = 0;
+			e.data_time  = 0;
+			e.cost       = 0;
+			
+			e.lru = its_lru.insert( its_lru.begin(), path );
+			
+			return e;
+		}
+		
+		entry& e = it->second;
+		
+		its_lru.splice( its_lru.begin(), its_lru, e.lru );
+		
+		return e;
+	}
+	
+	void client_cache::update_cost( entry& e )
+	{
+		// Count the bytes we hold, plus a rough allowance for overhead.
+		
+		const size_t overhead = 128;
+		
+		size_t cost = overhead + e.lru->size() + e.data.size();
+		
+		for ( size_t i = 0;  i < e.names.size();  ++i )
+		{
+			cost += overhead / 4 + e.names[ i ].size();
+		}
+		
+		its_total += cost - e.cost;
+		
+		e.cost = cost;
+	}
+	
+	void client_cache::evict()
+	{
+		while ( its_total > its_budget  &&  ! its_lru.empty() )
+		{
+			entry_map::iterator it = its_entries.find( its_lru.back() );
+			
+			its_total -= it->second.cost;
+			
+			its_entries.erase( it );
+			
+			its_lru.pop_back();
+		}
+	}
+	
+	file_attrs client_cache::stat( int in, int out, const plus::string& path )
+	{
+		const uint64_t now = now_ms();
+		
+		entry_map::iterator it = its_entries.find( path );
+		
+		if ( it != its_entries.end()  &&  fresh( it->second.attrs_time, now ) )
+		{
+			return touch( path ).attrs;
+		}
+		
+		prepare( in, out, path );
+		
+		fetch f( out, 1 );
+		
+		send_stat_request( out, path.data(), path.size(), stat_id );
+		
+		run_fetch( f, in, path );
+		
+		if ( f.stat_result != 0 )
+		{
+			invalidate( path );
+			
+			throw path_error( path, f.stat_result );
+		}
+		
+		entry& e = touch( path );
+		
+		e.attrs      = f.attrs;
+		e.attrs_time = now;
+		
+		update_cost( e );
+		evict();
+		
+		return f.attrs;
+	}
+	
+	void client_cache::dir( int                  in,
+	                        int                  out,
+	                        const plus::string&  path,
+	                        dirent_callback      dirent,
+	                        void*                x )
+	{
+		const uint64_t now = now_ms();
+		
+		entry_map::iterator it = its_entries.find( path );
+		
+		std::vector< plus::string > names;
+		
+		if ( it != its_entries.end()  &&  fresh( it->second.names_time, now ) )
+		{
+			names = touch( path ).names;
+		}
+		else
+		{
+			prepare( in, out, path );
+			
+			fetch f( out, 1 );
+			
+			send_list_request( out, path.data(), path.size(), body_id );
+			
+			run_fetch( f, in, path );
+			
+			if ( f.body_result != 0 )
+			{
+				invalidate( path );
+				
+				throw path_error( path, f.body_result );
+			}
+			
+			entry& e = touch( path );
+			
+			e.names.swap( f.names );
+			e.names_time = now;
+			
+			names = e.names;
+			
+			update_cost( e );
+			evict();
+		}
+		
+		for ( size_t i = 0;  i < names.size();  ++i )
+		{
+			dirent( names[ i ].data(), names[ i ].size(), x );
+		}
+	}
+	
+	plus::string client_cache::get( int in, int out, const plus::string& path )
+	{
+		const uint64_t now = now_ms();
+		
+		entry_map::iterator it = its_entries.find( path );
+		
+		if ( it != its_entries.end()  &&  it->second.data_time != 0 )
+		{
+			entry& e = touch( path );
+			
+			if ( fresh( e.data_time, now ) )
+			{
+				return e.data;
+			}
+			
+			if ( e.attrs.mtime != 0 )
+			{
+				// Revalidate with just a stat.
+				
+				const file_attrs old = e.attrs;
+				
+				const file_attrs attrs = stat( in, out, path );  // may evict
+				
+				if ( attrs.mtime == old.mtime  &&  attrs.size == old.size )
+				{
+					entry& same = touch( path );
+					
+					if ( same.data_time != 0 )
+					{
+						same.data_time = now;
+						
+						return same.data;
+					}
+				}
+			}
+		}
+		
+		prepare( in, out, path );
+		
+		fetch f( out, 2 );
+		
+		send_stat_request( out, path.data(), path.size(), stat_id );
+		send_read_request( out, path.data(), path.size(), body_id );
+		
+		run_fetch( f, in, path );
+		
+		if ( f.body_result != 0 )
+		{
+			invalidate( path );
+			
+			throw path_error( path, f.body_result );
+		}
+		
+		const plus::string data = f.data.move();
+		
+		entry& e = touch( path );
+		
+		e.data      = data;
+		e.data_time = now;
+		
+		if ( f.stat_result == 0 )
+		{
+			e.attrs      = f.attrs;
+			e.attrs_time = now;
+		}
+		
+		update_cost( e );
+		evict();
+		
+		return data;
+	}
+	
+	void client_cache::invalidate( const plus::string& path )
+	{
+		entry_map::iterator it = its_entries.find( path );
+		
+		if ( it != its_entries.end() )
+		{
+			its_total -= it->second.cost;
+			
+			its_lru.erase( it->second.lru );
+			
+			its_entries.erase( it );
+		}
+	}
+	
+	void client_cache::clear()
+	{
+		its_entries.clear();
+		its_lru.clear();
+		
+		its_total = 0;
+	}
+	
+}
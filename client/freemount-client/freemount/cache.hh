@@ -0,0 +1,136 @@
+/*
+	freemount/cache.hh
+	------------------
+*/
+
+#ifndef FREEMOUNT_CACHE_HH
+#define FREEMOUNT_CACHE_HH
+
+// Standard C++
+#include <list>
+#include <map>
+#include <vector>
+
+// Standard C
+#include <stddef.h>
+#include <stdint.h>
+
+// plus
+#include "plus/string.hh"
+
+// freemount-client
+#include "freemount/synced.hh"
+
+
+namespace freemount
+{
+	
+	struct file_attrs
+	{
+		uint32_t  mode;
+		uint32_t  nlink;
+		uint64_t  size;
+		uint64_t  mtime;  // in ns; zero if the server didn't send it
+	};
+	
+	/*
+		A client_cache answers repeated stat, list, and read requests for
+		the same paths without a round trip each time.  It's a drop-in for
+		the corresponding synced_* calls, and throws the same exceptions.
+		
+		Attributes and listings are trusted until they're older than the
+		TTL.  So is file data; after that, it's revalidated with a stat and
+		kept if the size and mtime haven't changed.  (Servers send mtimes
+		only if Feature_stat_mtime was negotiated; without them, stale data
+		is simply fetched again.)  On a miss, the stat and the read are sent
+		together, so they cost only one round trip.
+		
+		Before its first request, the cache negotiates Feature_stat_mtime.
+		A vers request replaces whatever features were granted before, so
+		a client that wants others too should call negotiate() with them
+		instead, before making any other requests.
+		
+		Entries are evicted least recently used first, to keep the bytes
+		held under the budget.  The cache doesn't see writes made through
+		other means, so invalidate() a path after modifying it.
+	*/
+	
+	class client_cache
+	{
+		private:
+			typedef std::list< plus::string > lru_list;
+			
+			struct entry
+			{
+				lru_list::iterator  lru;
+				
+				file_attrs  attrs;
+				
+				std::vector< plus::string >  names;
+				
+				plus::string  data;
+				
+				uint64_t  attrs_time;  // zero if absent
+				uint64_t  names_time;
+				uint64_t  data_time;
+				
+				size_t  cost;
+			};
+			
+			typedef std::map< plus::string, entry > entry_map;
+			
+			entry_map  its_entries;
+			lru_list   its_lru;
+			
+			size_t    its_budget;
+			size_t    its_total;
+			uint64_t  its_ttl;  // milliseconds
+			bool      its_negotiated;
+			
+			void prepare( int in, int out, const plus::string& path );
+			
+			entry& touch( const plus::string& path );
+			
+			void update_cost( entry& e );
+			void evict();
+			
+			bool fresh( uint64_t when, uint64_t now ) const
+			{
+				return when != 0  &&  now - when < its_ttl;
+			}
+			
+			// non-copyable
+			client_cache           ( const client_cache& );
+			client_cache& operator=( const client_cache& );
+		
+		public:
+			static const size_t   default_budget = 1 << 20;  // 1 MiB
+			static const unsigned default_ttl    = 1000;     // 1 second
+			
+			client_cache( size_t    budget = default_budget,
+			              unsigned  ttl_ms = default_ttl );
+			
+			size_t size() const  { return its_total; }
+			
+			// Returns the granted features, or a negative errno value.
+			
+			int negotiate( int in, int out, uint32_t features = 0 );
+			
+			file_attrs stat( int in, int out, const plus::string& path );
+			
+			void dir( int                  in,
+			          int                  out,
+			          const plus::string&  path,
+			          dirent_callback      dirent,
+			          void*                x );
+			
+			plus::string get( int in, int out, const plus::string& path );
+			
+			void invalidate( const plus::string& path );
+			
+			void clear();
+	};
+	
+}
+
+#endif
@@ -0,0 +1,226 @@
+/*
+	freemount/connection.cc
+	-----------------------
+*/
+
+#include "freemount/connection.hh"
+
+// POSIX
+#include <unistd.h>
+
+// Standard C
+#include <errno.h>
+
+// freemount
+#include "freemount/event_loop.hh"
+#include "freemount/frame_size.hh"
+#include "freemount/negotiate.hh"
+#include "freemount/send.hh"
+
+
+#define STR_LEN( s )  "" s, (sizeof s - 1)
+
+
+namespace freemount
+{
+	
+	connection::connection( int in, int out )
+	:
+		its_in( in ),
+		its_out( out ),
+		its_acks( out ),
+		its_receiver( &frame_handler, this, &batch_end ),
+		its_handlers( 1 << 8 ),  // 256
+		its_n_pending(),
+		its_max_payload( max_plain_payload ),
+		its_last_id(),
+		its_dispatching()
+	{
+	}
+	
+	int connection::frame_handler( void* that, const frame_header& frame )
+	{
+		connection& c = *(connection*) that;
+		
+		switch ( frame.type )
+		{
+			case Frame_fatal:
+				write( STDERR_FILENO, STR_LEN( "[FATAL]: " ) );
+				write( STDERR_FILENO, get_char_data( frame ), get_size( frame ) );
+				write( STDERR_FILENO, STR_LEN( "\n" ) );
+				return 0;
+			
+			case Frame_error:
+				write( STDERR_FILENO, STR_LEN( "[ERROR]: " ) );
+				write( STDERR_FILENO, get_char_data( frame ), get_size( frame ) );
+				write( STDERR_FILENO, STR_LEN( "\n" ) );
+				return 0;
+			
+			case Frame_debug:
+				write( STDERR_FILENO, STR_LEN( "[DEBUG]: " ) );
+				write( STDERR_FILENO, get_char_data( frame ), get_size( frame ) );
+				write( STDERR_FILENO, STR_LEN( "\n" ) );
+				return 0;
+			
+			case Frame_ping:
+				send_empty_frame( c.its_out, Frame_pong );
+				return 0;
+			
+			case Frame_pong:
+			case Frame_ack_read:
+			case Frame_ack_write:
+				return 0;
+			
+			case Frame_recv_data:
+				c.its_acks.acknowledge( get_size( frame ) );
+				break;
+			
+			default:
+				break;
+		}
+		
+		const uint16_t id = get_request_id( frame );
+		
+		if ( ! c.pending( id ) )
+		{
+			return -EPROTO;  // response to no outstanding request
+		}
+		
+		response_handler& h = c.its_handlers[ id ];
+		
+		if ( frame.type != Frame_result )
+		{
+			if ( h.on_frame )
+			{
+				h.on_frame( h.x, frame );
+			}
+			
+			return 0;
+		}
+		
+		h.pending = false;
+		
+		--c.its_n_pending;
+		
+		if ( h.on_result )
+		{
+			h.on_result( h.x, get_u32( frame ) );
+		}
+		
+		return 0;
+	}
+	
+	int connection::batch_end( void* that )
+	{
+		connection& c = *(connection*) that;
+		
+		c.its_acks.flush();
+		
+		return 0;
+	}
+	
+	int connection::receive()
+	{
+		its_dispatching = true;
+		
+		const int status = receive_batch( its_receiver, its_in );
+		
+		its_dispatching = false;
+		
+		return status;
+	}
+	
+	int connection::begin_request( response_frame_callback   on_frame,
+	                               response_result_callback  on_result,
+	                               void*                     x )
+	{
+		const unsigned n_ids = its_handlers.size();
+		
+		while ( its_n_pending == n_ids - 1 )
+		{
+			if ( its_dispatching )
+			{
+				return -EAGAIN;
+			}
+			
+			if ( int nok = receive() )
+			{
+				return nok;
+			}
+		}
+		
+		// Allocate ids round-robin, so a just-finished id isn't reused first.
+		
+		uint16_t id = its_last_id;
+		
+		do
+		{
+			id = (id + 1) % n_ids;
+		}
+		while ( id == 0  ||  its_handlers[ id ].pending );
+		
+		its_last_id = id;
+		
+		response_handler& h = its_handlers[ id ];
+		
+		h.on_frame  = on_frame;
+		h.on_result = on_result;
+		h.x         = x;
+		h.pending   = true;
+		
+		++its_n_pending;
+		
+		return id;
+	}
+	
+	int connection::negotiate( uint32_t features )
+	{
+		if ( its_n_pending )
+		{
+			return -EBUSY;
+		}
+		
+		session_params params;
+		
+		if ( int nok = freemount::negotiate( its_in, its_out, features, params ) )
+		{
+			return nok;
+		}
+		
+		if ( params.features & Feature_wide_ids )
+		{
+			its_handlers.resize( 1 << 16 );  // 65536
+		}
+		
+		its_max_payload = params.max_payload;
+		
+		return params.features;
+	}
+	
+	int connection::wait( uint16_t r_id )
+	{
+		while ( pending( r_id ) )
+		{
+			if ( int nok = receive() )
+			{
+				return nok;
+			}
+		}
+		
+		return 0;
+	}
+	
+	int connection::wait_all()
+	{
+		while ( its_n_pending )
+		{
+			if ( int nok = receive() )
+			{
+				return nok;
+			}
+		}
+		
+		return 0;
+	}
+	
+}
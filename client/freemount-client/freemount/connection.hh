@@ -0,0 +1,116 @@
+/*
+	freemount/connection.hh
+	-----------------------
+*/
+
+#ifndef FREEMOUNT_CONNECTION_HH
+#define FREEMOUNT_CONNECTION_HH
+
+// Standard C++
+#include <vector>
+
+// Standard C
+#include <stdint.h>
+
+// freemount
+#include "freemount/frame.hh"
+#include "freemount/receiver.hh"
+#include "freemount/send_ack.hh"
+
+
+namespace freemount
+{
+	
+	/*
+		A connection keeps many requests in flight at once, unlike the
+		synced_* functions, which wait out a round trip for each one.
+		
+		begin_request() allocates a request id and registers callbacks for
+		the response.  Send the request with that id, using the functions in
+		requests.hh and output().  Response frames are routed by request id:
+		on_frame is called for each frame before the result (stat fields,
+		directory entries, data), and on_result is called with zero or an
+		errno value when the result arrives, after which the id is free.
+		
+		Up to 255 requests can be outstanding (id 0 is never allocated), or
+		65535 once negotiate() obtains Feature_wide_ids from the server (and
+		Feature_jumbo_frames raises max_payload() to max_jumbo_payload);
+		begin_request() receives responses until an id is available.  The
+		wait functions receive responses until the given request (or all
+		of them) are done.  They return zero, or a negative errno value if
+		the connection fails.  Read acks are coalesced per batch.
+		
+		Callbacks may begin new requests, but if none are available then
+		begin_request() returns -EAGAIN, since it can't wait from there.
+		
+		negotiate() performs the vers handshake (see negotiate.hh) and
+		returns the features granted, or a negative errno value.  Call it
+		before beginning any requests.
+	*/
+	
+	typedef void (*response_frame_callback )( void* x, const frame_header& frame );
+	typedef void (*response_result_callback)( void* x, uint32_t result );
+	
+	class connection
+	{
+		private:
+			struct response_handler
+			{
+				response_frame_callback   on_frame;
+				response_result_callback  on_result;
+				void*                     x;
+				bool                      pending;
+			};
+			
+			int its_in;
+			int its_out;
+			
+			read_ack_queue  its_acks;
+			data_receiver   its_receiver;
+			
+			std::vector< response_handler > its_handlers;
+			
+			unsigned  its_n_pending;
+			uint32_t  its_max_payload;
+			uint16_t  its_last_id;
+			bool      its_dispatching;
+			
+			static int frame_handler( void* that, const frame_header& frame );
+			static int batch_end( void* that );
+			
+			int receive();
+			
+			// non-copyable
+			connection           ( const connection& );
+			connection& operator=( const connection& );
+		
+		public:
+			connection( int in, int out );
+			
+			int input () const  { return its_in;  }
+			int output() const  { return its_out; }
+			
+			unsigned n_pending() const  { return its_n_pending; }
+			
+			// Pass to queue_buffer() as the max_length.
+			
+			uint32_t max_payload() const  { return its_max_payload; }
+			
+			bool pending( uint16_t r_id ) const
+			{
+				return r_id < its_handlers.size()  &&  its_handlers[ r_id ].pending;
+			}
+			
+			int negotiate( uint32_t features );
+			
+			int begin_request( response_frame_callback   on_frame,
+			                   response_result_callback  on_result,
+			                   void*                     x );
+			
+			int wait( uint16_t r_id );
+			int wait_all();
+	};
+	
+}
+
+#endif
@@ -0,0 +1,150 @@
+/*
+	freemount/negotiate.cc
+	----------------------
+*/
+
+#include "freemount/negotiate.hh"
+
+// Standard C
+#include <errno.h>
+#include <stdlib.h>
+
+// freemount
+#include "freemount/event_loop.hh"
+#include "freemount/frame_size.hh"
+#include "freemount/queue_utils.hh"
+#include "freemount/receiver.hh"
+#include "freemount/requests.hh"
+#include "freemount/send_ack.hh"
+#include "freemount/send_queue.hh"
+
+
+namespace freemount
+{
+	
+	static
+	int pong_handler( void* that, const frame_header& frame )
+	{
+		if ( frame.type != Frame_pong )
+		{
+			return 0;
+		}
+		
+		*(uint8_t*) that = frame.data;
+		
+		return 1;
+	}
+	
+	static
+	int vers_handler( void* that, const frame_header& frame )
+	{
+		session_params& params = *(session_params*) that;
+		
+		switch ( frame.type )
+		{
+			case Frame_features:
+				params.features = get_u32( frame );
+				break;
+			
+			case Frame_max_payload:
+				params.max_payload = get_u32( frame );
+				break;
+			
+			case Frame_window:
+				params.window = get_u32( frame );
+				break;
+			
+			case Frame_result:
+				if ( get_u32( frame ) != 0 )
+				{
+					params.features = 0;
+				}
+				
+				return 1;
+			
+			default:
+				break;
+		}
+		
+		return 0;
+	}
+	
+	static
+	int run_until_done( frame_handler_function handler, void* that, int in )
+	{
+		data_receiver r( handler, that );
+		
+		const int looped = run_event_loop( r, in );
+		
+		return looped == 0 ? -ECONNRESET
+		     : looped  < 0 ? looped
+		     :               0;
+	}
+	
+	int negotiate( int in, int out, uint32_t features, session_params& params )
+	{
+		params.features    = 0;
+		params.max_payload = max_plain_payload;
+		params.window      = 0;
+		
+		if ( features == 0 )
+		{
+			return 0;
+		}
+		
+		send_queue queue( out );
+		
+		queue_int( queue, Frame_ping, protocol_version );
+		
+		queue.flush();
+		
+		uint8_t version = 0;
+		
+		if ( int nok = run_until_done( &pong_handler, &version, in ) )
+		{
+			return nok;
+		}
+		
+		if ( version == 0 )
+		{
+			return 0;  // the server predates vers
+		}
+		
+		send_vers_request( out, features );
+		
+		const int nok = run_until_done( &vers_handler, &params, in );
+		
+		if ( params.max_payload > max_jumbo_payload )
+		{
+			params.max_payload = max_jumbo_payload;
+		}
+		
+		if ( params.max_payload > max_plain_payload )
+		{
+			params.max_payload &= ~3;  // a whole number of unpadded blocks
+		}
+		
+		return nok;
+	}
+	
+	uint32_t default_features()
+	{
+		if ( const char* features = getenv( "FREEMOUNT_FEATURES" ) )
+		{
+			return strtoul( features, NULL, 10 );
+		}
+		
+		return Feature_jumbo_frames | Feature_compression;
+	}
+	
+	unsigned read_ack_threshold( const session_params& params )
+	{
+		const unsigned threshold = read_ack_queue::default_threshold;
+		
+		const uint32_t half_window = params.window / 2;
+		
+		return half_window  &&  half_window < threshold ? half_window
+		                                                : threshold;
+	}
+	
+}
@@ -0,0 +1,49 @@
+/*
+	freemount/negotiate.hh
+	----------------------
+*/
+
+#ifndef FREEMOUNT_NEGOTIATE_HH
+#define FREEMOUNT_NEGOTIATE_HH
+
+// Standard C
+#include <stdint.h>
+
+
+namespace freemount
+{
+	
+	struct session_params
+	{
+		uint32_t  features;     // granted feature bits
+		uint32_t  max_payload;  // largest frame payload, either direction
+		uint32_t  window;       // server's congestion window, or zero
+	};
+	
+	/*
+		negotiate() asks the server for the given features and reports what
+		it granted.  It must precede any other requests on the connection.
+		
+		It first pings the server to check that it implements vers.  If it
+		doesn't, nothing is granted, and params describe the base protocol.
+		Either way, it returns zero, or a negative errno value if the
+		connection fails.
+	*/
+	
+	int negotiate( int in, int out, uint32_t features, session_params& params );
+	
+	/*
+		The features that client tools request by default.  Setting the
+		environment variable FREEMOUNT_FEATURES (to a decimal bit mask)
+		overrides it; zero skips negotiation altogether.
+	*/
+	
+	uint32_t default_features();
+	
+	// A read ack threshold that won't stall the server's congestion window
+	
+	unsigned read_ack_threshold( const session_params& params );
+	
+}
+
+#endif
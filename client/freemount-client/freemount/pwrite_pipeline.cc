@@ -0,0 +1,92 @@
+/*
+	freemount/pwrite_pipeline.cc
+	----------------------------
+*/
+
+#include "freemount/pwrite_pipeline.hh"
+
+// freemount-client
+#include "freemount/connection.hh"
+#include "freemount/requests.hh"
+#include "freemount/synced.hh"
+
+
+namespace freemount
+{
+	
+	pwrite_pipeline::pwrite_pipeline( connection&          c,
+	                                  const plus::string&  path,
+	                                  uint32_t             chunk_size )
+	:
+		its_connection( c ),
+		its_path( path ),
+		its_chunk_size( chunk_size ),
+		its_error()
+	{
+	}
+	
+	void pwrite_pipeline::record_result( void* that, uint32_t result )
+	{
+		pwrite_pipeline& pipeline = *(pwrite_pipeline*) that;
+		
+		if ( pipeline.its_error == 0 )
+		{
+			pipeline.its_error = result;
+		}
+	}
+	
+	void pwrite_pipeline::pwrite( const char* data, size_t size, uint32_t offset )
+	{
+		const int out = its_connection.output();
+		
+		while ( size > 0 )
+		{
+			const uint32_t n = size < its_chunk_size ? size : its_chunk_size;
+			
+			const int id = its_connection.begin_request( 0,  // NULL
+			                                             &record_result,
+			                                             this );
+			
+			if ( id < 0 )
+			{
+				throw connection_error( its_path, -id );
+			}
+			
+			its_ids.push_back( id );
+			
+			send_pwrite_request( out,
+			                     offset,
+			                     its_path.data(),
+			                     its_path.size(),
+			                     data,
+			                     n,
+			                     id,
+			                     its_connection.max_payload() );
+			
+			data   += n;
+			size   -= n;
+			offset += n;
+		}
+	}
+	
+	void pwrite_pipeline::finish()
+	{
+		for ( size_t i = 0;  i < its_ids.size();  ++i )
+		{
+			if ( int nok = its_connection.wait( its_ids[ i ] ) )
+			{
+				throw connection_error( its_path, -nok );
+			}
+		}
+		
+		its_ids.clear();
+		
+		if ( const uint32_t error = its_error )
+		{
+			its_error = 0;
+			
+			throw path_error( its_path, error );
+		}
+	}
+	
+}
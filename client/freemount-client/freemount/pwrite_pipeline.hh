@@ -0,0 +1,64 @@
+/*
+	freemount/pwrite_pipeline.hh
+	----------------------------
+*/
+
+#ifndef FREEMOUNT_PWRITEPIPELINE_HH
+#define FREEMOUNT_PWRITEPIPELINE_HH
+
+// Standard C++
+#include <vector>
+
+// Standard C
+#include <stddef.h>
+#include <stdint.h>
+
+// plus
+#include "plus/string.hh"
+
+
+namespace freemount
+{
+	
+	class connection;
+	
+	/*
+		A pwrite_pipeline writes ranges of one file, in chunks, without
+		waiting for each chunk's result before sending the next:  Every
+		chunk goes out as its own request, and finish() collects all the
+		results, so a batch of writes costs one round trip instead of one
+		per chunk.
+		
+		finish() throws path_error for the first chunk that failed, or
+		connection_error, like synced_pwrite().
+	*/
+	
+	class pwrite_pipeline
+	{
+		private:
+			connection&   its_connection;
+			plus::string  its_path;
+			uint32_t      its_chunk_size;
+			uint32_t      its_error;
+			
+			std::vector< uint16_t > its_ids;
+			
+			static void record_result( void* that, uint32_t result );
+			
+			// non-copyable
+			pwrite_pipeline           ( const pwrite_pipeline& );
+			pwrite_pipeline& operator=( const pwrite_pipeline& );
+		
+		public:
+			pwrite_pipeline( connection&          c,
+			                 const plus::string&  path,
+			                 uint32_t             chunk_size );
+			
+			void pwrite( const char* data, size_t size, uint32_t offset );
+			
+			void finish();
+	};
+	
+}
+
+#endif
@@ -6,6 +6,7 @@
 #include "freemount/requests.hh"
 
 // freemount
+#include "freemount/message.hh"
 #include "freemount/queue_utils.hh"
 #include "freemount/send_queue.hh"
 
@@ -14,123 +15,240 @@ namespace freemount
 {
 	
 	static inline
-	void queue_request( send_queue& queue, uint8_t request_type, uint8_t r_id )
+	void queue_request( send_queue& queue, uint8_t request_type, uint16_t r_id )
 	{
 		queue_int( queue, Frame_request, request_type, r_id );
 	}
 	
 	static inline
-	void queue_submit( send_queue& queue, uint8_t r_id )
+	void queue_submit( send_queue& queue, uint16_t r_id )
 	{
 		queue_empty( queue, Frame_submit, r_id );
 	}
 	
 	static inline
-	void queue_cancel( send_queue& queue, uint8_t r_id )
+	void queue_cancel( send_queue& queue, uint16_t r_id )
 	{
 		queue_empty( queue, Frame_cancel, r_id );
 	}
 	
-	void cancel_request( int fd, uint8_t r_id )
+	void cancel_request( send_queue& queue, uint16_t r_id )
+	{
+		queue_cancel( queue, r_id );
+	}
+	
+	void cancel_request( int fd, uint16_t r_id )
 	{
 		send_queue queue( fd );
 		
-		queue_cancel( queue, r_id );
+		cancel_request( queue, r_id );
 		
 		queue.flush();
 	}
 	
+	void send_vers_request( int fd, uint32_t features, uint16_t r_id )
+	{
+		message< arg_features > m( req_vers, arg_features( features ), r_id );
+		
+		m.send( fd );
+	}
+	
+	void send_path_request( send_queue&  queue,
+	                        const char*  path,
+	                        uint32_t     size,
+	                        uint8_t      r_type,
+	                        uint16_t     r_id )
+	{
+		message< arg_path > m( r_type, arg_path( path, size ), r_id );
+		
+		m.queue( queue );
+	}
+	
 	void send_path_request( int          fd,
 	                        const char*  path,
 	                        uint32_t     size,
 	                        uint8_t      r_type,
-	                        uint8_t      r_id )
+	                        uint16_t     r_id )
 	{
-		send_queue queue( fd );
+		message< arg_path > m( r_type, arg_path( path, size ), r_id );
 		
-		queue_request( queue, r_type, r_id );
+		m.send( fd );
+	}
+	
+	void send_sums_request( send_queue&  queue,
+	                        const char*  path,
+	                        uint32_t     size,
+	                        uint32_t     block_size,
+	                        uint16_t     r_id )
+	{
+		typedef message< arg_path, arg_block_size > sums_message;
 		
-		queue_string( queue, Frame_arg_path, path, size, r_id );
+		sums_message m( req_sums,
+		                arg_path( path, size ),
+		                arg_block_size( block_size ),
+		                r_id );
 		
-		queue_submit( queue, r_id );
+		m.queue( queue );
+	}
+	
+	void send_sums_request( int          fd,
+	                        const char*  path,
+	                        uint32_t     size,
+	                        uint32_t     block_size,
+	                        uint16_t     r_id )
+	{
+		typedef message< arg_path, arg_block_size > sums_message;
 		
-		queue.flush();
+		sums_message m( req_sums,
+		                arg_path( path, size ),
+		                arg_block_size( block_size ),
+		                r_id );
+		
+		m.send( fd );
 	}
 	
-	void send_write_request( int          fd,
+	void send_write_request( send_queue&  queue,
 	                         const char*  path,
 	                         uint32_t     path_size,
 	                         const char*  data,
 	                         uint32_t     data_size,
-	                         uint8_t      r_id )
+	                         uint16_t     r_id,
+	                         uint32_t     max_payload )
 	{
-		send_queue queue( fd );
-		
 		queue_request( queue, req_write, r_id );
 		
 		queue_string( queue, Frame_arg_path,  path, path_size, r_id );
-		queue_buffer( queue, Frame_send_data, data, data_size, r_id );
+		queue_buffer( queue, Frame_send_data, data, data_size, r_id, max_payload );
 		
 		queue_submit( queue, r_id );
+	}
+	
+	void send_write_request( int          fd,
+	                         const char*  path,
+	                         uint32_t     path_size,
+	                         const char*  data,
+	                         uint32_t     data_size,
+	                         uint16_t     r_id,
+	                         uint32_t     max_payload )
+	{
+		send_queue queue( fd );
+		
+		send_write_request( queue, path, path_size, data, data_size, r_id, max_payload );
 		
 		queue.flush();
 	}
 	
-	void send_pwrite_request( int          fd,
+	void send_pwrite_request( send_queue&  queue,
 	                          uint32_t     offset,
 	                          const char*  path,
 	                          uint32_t     path_size,
 	                          const char*  data,
 	                          uint32_t     data_size,
-	                          uint8_t      r_id )
+	                          uint16_t     r_id,
+	                          uint32_t     max_payload )
 	{
-		send_queue queue( fd );
-		
 		queue_request( queue, req_write, r_id );
 		
 		queue_int( queue, Frame_seek_offset, offset, r_id );
 		
 		queue_string( queue, Frame_arg_path,  path, path_size, r_id );
-		queue_buffer( queue, Frame_send_data, data, data_size, r_id );
+		queue_buffer( queue, Frame_send_data, data, data_size, r_id, max_payload );
 		
 		queue_submit( queue, r_id );
+	}
+	
+	void send_pwrite_request( int          fd,
+	                          uint32_t     offset,
+	                          const char*  path,
+	                          uint32_t     path_size,
+	                          const char*  data,
+	                          uint32_t     data_size,
+	                          uint16_t     r_id,
+	                          uint32_t     max_payload )
+	{
+		send_queue queue( fd );
+		
+		send_pwrite_request( queue, offset, path, path_size, data, data_size, r_id, max_payload );
 		
 		queue.flush();
 	}
 	
-	void send_open_request( int          fd,
+	void send_open_request( send_queue&  queue,
 	                        int          chosen_fd,
 	                        const char*  path,
 	                        uint32_t     path_size,
-	                        uint8_t      r_id )
+	                        uint16_t     r_id )
 	{
-		send_queue queue( fd );
-		
-		queue_request( queue, req_open, r_id );
+		const arg_path path_arg( path, path_size );
 		
 		if ( chosen_fd >= 0 )
 		{
-			queue_int( queue, Frame_arg_fd, chosen_fd, r_id );
+			typedef message< arg_fd, arg_path > open_message;
+			
+			open_message m( req_open, arg_fd( chosen_fd ), path_arg, r_id );
+			
+			m.queue( queue );
 		}
+		else
+		{
+			message< arg_path > m( req_open, path_arg, r_id );
+			
+			m.queue( queue );
+		}
+	}
+	
+	void send_open_request( int          fd,
+	                        int          chosen_fd,
+	                        const char*  path,
+	                        uint32_t     path_size,
+	                        uint16_t     r_id )
+	{
+		const arg_path path_arg( path, path_size );
 		
-		queue_string( queue, Frame_arg_path, path, path_size, r_id );
-		
-		queue_submit( queue, r_id );
-		
-		queue.flush();
+		if ( chosen_fd >= 0 )
+		{
+			typedef message< arg_fd, arg_path > open_message;
+			
+			open_message m( req_open, arg_fd( chosen_fd ), path_arg, r_id );
+			
+			m.send( fd );
+		}
+		else
+		{
+			message< arg_path > m( req_open, path_arg, r_id );
+			
+			m.send( fd );
+		}
 	}
 	
-	void send_close_request( int fd, int file_fd, uint8_t r_id )
+	void send_close_request( send_queue& queue, int file_fd, uint16_t r_id )
 	{
-		send_queue queue( fd );
+		message< arg_fd > m( req_close, arg_fd( file_fd ), r_id );
 		
-		queue_request( queue, req_close, r_id );
+		m.queue( queue );
+	}
+	
+	void send_close_request( int fd, int file_fd, uint16_t r_id )
+	{
+		message< arg_fd > m( req_close, arg_fd( file_fd ), r_id );
 		
-		queue_int( queue, Frame_arg_fd, file_fd, r_id );
+		m.send( fd );
+	}
+	
+	void send_link_request( send_queue&  queue,
+	                        const char*  src_path,
+	                        uint32_t     src_path_size,
+	                        const char*  dst_path,
+	                        uint32_t     dst_path_size,
+	                        uint16_t     r_id )
+	{
+		typedef message< arg_path, arg_path > link_message;
 		
-		queue_submit( queue, r_id );
+		link_message m( req_link, arg_path( src_path, src_path_size ),
+		                          arg_path( dst_path, dst_path_size ),
+		                          r_id );
 		
-		queue.flush();
+		m.queue( queue );
 	}
 	
 	void send_link_request( int          fd,
@@ -138,18 +256,15 @@ namespace freemount
 	                        uint32_t     src_path_size,
 	                        const char*  dst_path,
 	                        uint32_t     dst_path_size,
-	                        uint8_t      r_id )
+	                        uint16_t     r_id )
 	{
-		send_queue queue( fd );
-		
-		queue_request( queue, req_link, r_id );
+		typedef message< arg_path, arg_path > link_message;
 		
-		queue_string( queue, Frame_arg_path, src_path, src_path_size, r_id );
-		queue_string( queue, Frame_arg_path, dst_path, dst_path_size, r_id );
+		link_message m( req_link, arg_path( src_path, src_path_size ),
+		                          arg_path( dst_path, dst_path_size ),
+		                          r_id );
 		
-		queue_submit( queue, r_id );
-		
-		queue.flush();
+		m.send( fd );
 	}
 	
 }
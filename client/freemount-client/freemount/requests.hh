@@ -11,52 +11,154 @@
 
 // freemount
 #include "freemount/frame.hh"
+#include "freemount/frame_size.hh"
 
 
 namespace freemount
 {
 	
-	void cancel_request( int fd, uint8_t r_id );
+	class send_queue;
+	
+	/*
+		Each request function has two forms.  Given a file descriptor, it
+		sends the request immediately.  Given a send_queue, it only adds the
+		request to the queue, so that many requests can go out in a single
+		write when the caller flushes (or uncorks) the queue.  In that case,
+		a write request's data is referenced rather than copied, and must
+		remain valid until the queue is written.
+	*/
+	
+	void cancel_request( send_queue& queue, uint16_t r_id );
+	void cancel_request( int         fd,    uint16_t r_id );
+	
+	void send_vers_request( int fd, uint32_t features, uint16_t r_id = 0 );
+	
+	void send_path_request( send_queue&  queue,
+	                        const char*  path,
+	                        uint32_t     size,
+	                        uint8_t      r_type,
+	                        uint16_t     r_id = 0 );
 	
 	void send_path_request( int          fd,
 	                        const char*  path,
 	                        uint32_t     size,
 	                        uint8_t      r_type,
-	                        uint8_t      r_id = 0 );
+	                        uint16_t     r_id = 0 );
+	
+	inline
+	void send_stat_request( send_queue&  queue,
+	                        const char*  path,
+	                        uint32_t     size,
+	                        uint16_t     r_id = 0 )
+	{
+		send_path_request( queue, path, size, req_stat, r_id );
+	}
 	
 	inline
 	void send_stat_request( int          fd,
 	                        const char*  path,
 	                        uint32_t     size,
-	                        uint8_t      r_id = 0 )
+	                        uint16_t     r_id = 0 )
 	{
 		send_path_request( fd, path, size, req_stat, r_id );
 	}
 	
+	inline
+	void send_list_request( send_queue&  queue,
+	                        const char*  path,
+	                        uint32_t     size,
+	                        uint16_t     r_id = 0 )
+	{
+		send_path_request( queue, path, size, req_list, r_id );
+	}
+	
 	inline
 	void send_list_request( int          fd,
 	                        const char*  path,
 	                        uint32_t     size,
-	                        uint8_t      r_id = 0 )
+	                        uint16_t     r_id = 0 )
 	{
 		send_path_request( fd, path, size, req_list, r_id );
 	}
 	
+	inline
+	void send_read_request( send_queue&  queue,
+	                        const char*  path,
+	                        uint32_t     size,
+	                        uint16_t     r_id = 0 )
+	{
+		send_path_request( queue, path, size, req_read, r_id );
+	}
+	
 	inline
 	void send_read_request( int          fd,
 	                        const char*  path,
 	                        uint32_t     size,
-	                        uint8_t      r_id = 0 )
+	                        uint16_t     r_id = 0 )
 	{
 		send_path_request( fd, path, size, req_read, r_id );
 	}
 	
+	inline
+	void send_watch_request( send_queue&  queue,
+	                         const char*  path,
+	                         uint32_t     size,
+	                         uint16_t     r_id = 0 )
+	{
+		send_path_request( queue, path, size, req_watch, r_id );
+	}
+	
+	inline
+	void send_watch_request( int          fd,
+	                         const char*  path,
+	                         uint32_t     size,
+	                         uint16_t     r_id = 0 )
+	{
+		send_path_request( fd, path, size, req_watch, r_id );
+	}
+	
+	void send_sums_request( send_queue&  queue,
+	                        const char*  path,
+	                        uint32_t     size,
+	                        uint32_t     block_size,
+	                        uint16_t     r_id = 0 );
+	
+	void send_sums_request( int          fd,
+	                        const char*  path,
+	                        uint32_t     size,
+	                        uint32_t     block_size,
+	                        uint16_t     r_id = 0 );
+	
+	/*
+		The data goes in frames of up to max_payload bytes.  Pass a larger
+		maximum only if jumbo frames were negotiated (e.g. a connection's
+		max_payload()).
+	*/
+	
+	void send_write_request( send_queue&  queue,
+	                         const char*  path,
+	                         uint32_t     path_size,
+	                         const char*  data,
+	                         uint32_t     data_size,
+	                         uint16_t     r_id        = 0,
+	                         uint32_t     max_payload = max_plain_payload );
+	
 	void send_write_request( int          fd,
 	                         const char*  path,
 	                         uint32_t     path_size,
 	                         const char*  data,
 	                         uint32_t     data_size,
-	                         uint8_t      r_id = 0 );
+	                         uint16_t     r_id        = 0,
+	                         uint32_t     max_payload = max_plain_payload );
+	
+	void send_pwrite_request( send_queue&  queue,
+	                          uint32_t     offset,
+	                          const char*  path,
+	                          uint32_t     path_size,
+	                          const char*  data,
+	                          uint32_t     data_size,
+	                          uint16_t     r_id        = 0,
+	                          uint32_t     max_payload = max_plain_payload );
 	
 	void send_pwrite_request( int          fd,
 	                          uint32_t     offset,
@@ -64,22 +166,37 @@ namespace freemount
 	                          uint32_t     path_size,
 	                          const char*  data,
 	                          uint32_t     data_size,
-	                          uint8_t      r_id = 0 );
+	                          uint16_t     r_id        = 0,
+	                          uint32_t     max_payload = max_plain_payload );
+	
+	void send_open_request( send_queue&  queue,
+	                        int          chosen_fd,
+	                        const char*  path,
+	                        uint32_t     path_size,
+	                        uint16_t     r_id = 0 );
 	
 	void send_open_request( int          fd,
 	                        int          chosen_fd,
 	                        const char*  path,
 	                        uint32_t     path_size,
-	                        uint8_t      r_id = 0 );
+	                        uint16_t     r_id = 0 );
 	
-	void send_close_request( int fd, int file_fd, uint8_t r_id = 0 );
+	void send_close_request( send_queue& queue, int file_fd, uint16_t r_id = 0 );
+	void send_close_request( int         fd,    int file_fd, uint16_t r_id = 0 );
+	
+	void send_link_request( send_queue&  queue,
+	                        const char*  src_path,
+	                        uint32_t     src_path_size,
+	                        const char*  dst_path,
+	                        uint32_t     dst_path_size,
+	                        uint16_t     r_id = 0 );
 	
 	void send_link_request( int          fd,
 	                        const char*  src_path,
 	                        uint32_t     src_path_size,
 	                        const char*  dst_path,
 	                        uint32_t     dst_path_size,
-	                        uint8_t      r_id = 0 );
+	                        uint16_t     r_id = 0 );
 	
 }
 
@@ -0,0 +1,77 @@
+/*
+	freemount/seed_waiter.cc
+	------------------------
+*/
+
+#include "freemount/seed_waiter.hh"
+
+// POSIX
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+// Standard C
+#include <limits.h>
+#include <stdlib.h>
+
+
+namespace freemount
+{
+	
+	const int polling_interval  = 10;  // milliseconds
+	const int backstop_interval = 1000;
+	
+	seed_waiter::seed_waiter()
+	:
+		its_producer_wakes( getenv( "GRAPHICS_UPDATE_WAKES_WAITERS" ) != 0 )  // NULL
+	{
+	}
+	
+#ifdef __linux__
+	
+	/*
+		The raster is mapped shared between processes, so we use shared
+		(not FUTEX_PRIVATE_FLAG) futex operations.
+	*/
+	
+	static inline
+	int futex_wait( const volatile uint32_t* addr, uint32_t value, const timespec* timeout )
+	{
+		return syscall( SYS_futex, addr, FUTEX_WAIT, value, timeout, NULL, 0 );
+	}
+	
+	void seed_waiter::wait( const volatile uint32_t* seed, uint32_t last_seed )
+	{
+		const int ms = its_producer_wakes ? backstop_interval : polling_interval;
+		
+		const timespec timeout = { ms / 1000, ms % 1000 * 1000000 };
+		
+		futex_wait( seed, last_seed, &timeout );
+	}
+	
+	void wake_seed_waiters( volatile uint32_t* seed )
+	{
+		syscall( SYS_futex, seed, FUTEX_WAKE, INT_MAX, NULL, NULL, 0 );
+	}
+	
+#else
+	
+	void seed_waiter::wait( const volatile uint32_t* seed, uint32_t last_seed )
+	{
+		if ( *seed == last_seed )
+		{
+			usleep( polling_interval * 1000 );
+		}
+	}
+	
+	void wake_seed_waiters( volatile uint32_t* seed )
+	{
+	}
+	
+#endif
+	
+}
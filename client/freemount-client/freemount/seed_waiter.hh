@@ -0,0 +1,55 @@
+/*
+	freemount/seed_waiter.hh
+	------------------------
+*/
+
+#ifndef FREEMOUNT_SEEDWAITER_HH
+#define FREEMOUNT_SEEDWAITER_HH
+
+// Standard C
+#include <stdint.h>
+
+
+namespace freemount
+{
+	
+	/*
+		A seed_waiter waits for a raster's sync seed to change, without the
+		GRAPHICS_UPDATE_SIGNAL_FIFO.  Each wait() returns after the seed has
+		changed, a timeout, or a signal, so callers should loop (and may
+		check for cancellation in between).
+		
+		On Linux, it waits on a futex at the seed's address.  A producer
+		that calls wake_seed_waiters() after each change of the seed (or
+		status) advertises that by setting GRAPHICS_UPDATE_WAKES_WAITERS in
+		the environment; then wait()'s timeout is a one-second backstop, so
+		a caller can notice cancellation, and an idle display costs almost
+		nothing.  Otherwise, the timeout is 10ms, as when polling, so that
+		updates from producers that don't wake waiters aren't missed for
+		long.  Elsewhere, wait() just sleeps for 10ms.
+	*/
+	
+	class seed_waiter
+	{
+		private:
+			bool its_producer_wakes;
+		
+		public:
+			seed_waiter();  // checks the environment
+			
+			explicit seed_waiter( bool producer_wakes )
+			:
+				its_producer_wakes( producer_wakes )
+			{
+			}
+			
+			bool producer_wakes() const  { return its_producer_wakes; }
+			
+			void wait( const volatile uint32_t* seed, uint32_t last_seed );
+	};
+	
+	void wake_seed_waiters( volatile uint32_t* seed );
+	
+}
+
+#endif
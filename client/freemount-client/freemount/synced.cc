@@ -5,6 +5,9 @@
 
 #include "freemount/synced.hh"
 
+// Standard C++
+#include <exception>
+
 // Standard C
 #include <errno.h>
 
@@ -14,6 +17,7 @@
 // freemount
 #include "freemount/event_loop.hh"
 #include "freemount/frame_size.hh"
+#include "freemount/message.hh"
 #include "freemount/receiver.hh"
 #include "freemount/requests.hh"
 #include "freemount/send_ack.hh"
@@ -26,25 +30,34 @@ namespace freemount
 	{
 		dirent_callback   dirent;
 		void*             handle;
-		int               out_fd;
+		read_ack_queue    acks;
 		int32_t           result;
 		plus::var_string  data;
 		
-		request_status( int fd )
+		request_status( int fd ) : acks( fd )
 		{
 			dirent = 0;  // NULL
-			out_fd = fd;
 			result = -1;
 		}
 	};
 	
+	static
+	int batch_end( void* that )
+	{
+		request_status& req = *(request_status*) that;
+		
+		req.acks.flush();
+		
+		return 0;
+	}
+	
 	static
 	int wait_for_result( request_status&         req,
 	                     int                     fd,
 	                     frame_handler_function  handler,
 	                     const plus::string&     path )
 	{
-		data_receiver r( handler, &req );
+		data_receiver r( handler, &req, &batch_end );
 		
 		int looped = run_event_loop( r, fd );
 		
@@ -76,7 +89,7 @@ namespace freemount
 		
 		if ( frame.type == Frame_recv_data )
 		{
-			send_read_ack( req.out_fd, get_size( frame ) );
+			req.acks.acknowledge( get_size( frame ) );
 			
 			req.data.append( get_char_data( frame ), get_size( frame ) );
 			return 0;
@@ -105,12 +118,148 @@ namespace freemount
 		throw unexpected_frame_type( frame.type );
 	}
 	
+	static synced_batch* current_batch;
+	
+	synced_batch::synced_batch( int in, int out )
+	:
+		its_in ( in  ),
+		its_out( out ),
+		its_queue( out ),
+		its_n_pending(),
+		its_failed_id(),
+		its_error(),
+		its_outer( current_batch )
+	{
+		current_batch = this;
+	}
+	
+	synced_batch::~synced_batch()
+	{
+		/*
+			If we're unwinding, whatever was queued is moot.
+		*/
+		
+		if ( ! std::uncaught_exception() )
+		{
+			try
+			{
+				finish();
+			}
+			catch ( ... )
+			{
+			}
+		}
+		
+		current_batch = its_outer;
+	}
+	
+	synced_batch* synced_batch::active( int out )
+	{
+		synced_batch* batch = current_batch;
+		
+		return batch  &&  batch->its_out == out ? batch : 0;  // NULL
+	}
+	
+	uint16_t synced_batch::next_request( const char* path, uint32_t path_size )
+	{
+		/*
+			Without negotiating wide request ids, we're limited to 255.
+		*/
+		
+		if ( its_paths.size() == 255 )
+		{
+			finish();
+		}
+		
+		its_paths.push_back( plus::string( path, path_size ) );
+		
+		++its_n_pending;
+		
+		return its_paths.size();
+	}
+	
+	int synced_batch::frame_handler( void* that, const frame_header& frame )
+	{
+		synced_batch& batch = *(synced_batch*) that;
+		
+		const uint16_t r_id = get_request_id( frame );
+		
+		if ( frame.type != Frame_result  ||  r_id - 1u >= batch.its_paths.size() )
+		{
+			throw unexpected_frame_type( frame.type );
+		}
+		
+		if ( const int result = get_u32( frame ) )
+		{
+			if ( batch.its_failed_id == 0  ||  r_id < batch.its_failed_id )
+			{
+				batch.its_failed_id = r_id;
+				batch.its_error     = result;
+			}
+		}
+		
+		return --batch.its_n_pending == 0;
+	}
+	
+	void synced_batch::finish()
+	{
+		if ( its_paths.empty() )
+		{
+			return;
+		}
+		
+		its_queue.flush();
+		
+		const plus::string first_path = its_paths[ 0 ];
+		
+		if ( its_n_pending )
+		{
+			data_receiver r( &frame_handler, this );
+			
+			int looped = run_event_loop( r, its_in );
+			
+			if ( looped < 0  ||  (looped == 0  &&  (looped = -ECONNRESET)) )
+			{
+				its_paths.clear();
+				its_n_pending = 0;
+				
+				throw connection_error( first_path, -looped );
+			}
+		}
+		
+		const uint16_t failed_id = its_failed_id;
+		
+		its_failed_id = 0;
+		
+		if ( failed_id )
+		{
+			const plus::string path = its_paths[ failed_id - 1 ];
+			
+			its_paths.clear();
+			
+			throw path_error( path, its_error );
+		}
+		
+		its_paths.clear();
+	}
+	
+	static inline
+	void finish_batch( int out )
+	{
+		if ( synced_batch* batch = synced_batch::active( out ) )
+		{
+			batch->finish();
+		}
+	}
+	
 	void synced_dir( int                  in,
 	                 int                  out,
 	                 const plus::string&  path,
 	                 dirent_callback      dirent,
 	                 void*                x )
 	{
+		finish_batch( out );
+		
 		send_list_request( out, path.data(), path.size() );
 		
 		request_status req( out );
@@ -128,6 +277,8 @@ namespace freemount
 	
 	plus::string synced_get( int in, int out, const plus::string& path )
 	{
+		finish_batch( out );
+		
 		send_read_request( out, path.data(), path.size() );
 		
 		request_status req( out );
@@ -147,9 +298,28 @@ namespace freemount
 	                 const char*  path,
 	                 uint32_t     path_size,
 	                 const char*  data,
-	                 uint32_t     data_size )
+	                 uint32_t     data_size,
+	                 uint32_t     max_payload )
 	{
-		send_write_request( out, path, path_size, data, data_size );
+		synced_batch* batch = synced_batch::active( out );
+		
+		if ( batch  &&  data_size <= max_payload )
+		{
+			const uint16_t r_id = batch->next_request( path, path_size );
+			
+			message< arg_path, arg_data > m( req_write,
+			                                 arg_path( path, path_size ),
+			                                 arg_data( data, data_size ),
+			                                 r_id,
+			                                 max_payload );
+			
+			m.queue( batch->queue() );
+			return;
+		}
+		
+		finish_batch( out );
+		
+		send_write_request( out, path, path_size, data, data_size, 0, max_payload );
 		
 		request_status req( out );
 		
@@ -167,9 +337,31 @@ namespace freemount
 	                    uint32_t     path_size,
 	                    const char*  data,
 	                    uint32_t     data_size,
-	                    uint32_t     offset )
+	                    uint32_t     offset,
+	                    uint32_t     max_payload )
 	{
-		send_pwrite_request( out, offset, path, path_size, data, data_size );
+		synced_batch* batch = synced_batch::active( out );
+		
+		if ( batch  &&  data_size <= max_payload )
+		{
+			typedef message< arg_offset, arg_path, arg_data > pwrite_message;
+			
+			const uint16_t r_id = batch->next_request( path, path_size );
+			
+			pwrite_message m( req_write,
+			                  arg_offset( offset ),
+			                  arg_path( path, path_size ),
+			                  arg_data( data, data_size ),
+			                  r_id,
+			                  max_payload );
+			
+			m.queue( batch->queue() );
+			return;
+		}
+		
+		finish_batch( out );
+		
+		send_pwrite_request( out, offset, path, path_size, data, data_size, 0, max_payload );
 		
 		request_status req( out );
 		
@@ -187,6 +379,26 @@ namespace freemount
 	                 const char*  path,
 	                 uint32_t     path_size )
 	{
+		synced_batch* batch = synced_batch::active( out );
+		
+		if ( batch  &&  chosen_fd >= 0 )
+		{
+			typedef message< arg_fd, arg_path > open_message;
+			
+			const uint16_t r_id = batch->next_request( path, path_size );
+			
+			open_message m( req_open,
+			                arg_fd( chosen_fd ),
+			                arg_path( path, path_size ),
+			                r_id );
+			
+			m.queue( batch->queue() );
+			
+			return chosen_fd;
+		}
+		
+		finish_batch( out );
+		
 		send_open_request( out, chosen_fd, path, path_size );
 		
 		request_status req( out );
@@ -203,6 +415,8 @@ namespace freemount
 	
 	void synced_close( int in, int out, int fd )
 	{
+		finish_batch( out );
+		
 		send_close_request( out, fd );
 		
 		request_status req( out );
@@ -224,6 +438,20 @@ namespace freemount
 	                  const char*  dst_path,
 	                  uint32_t     dst_path_size )
 	{
+		if ( synced_batch* batch = synced_batch::active( out ) )
+		{
+			typedef message< arg_path, arg_path > link_message;
+			
+			const uint16_t r_id = batch->next_request( src_path, src_path_size );
+			
+			link_message m( req_link, arg_path( src_path, src_path_size ),
+			                          arg_path( dst_path, dst_path_size ),
+			                          r_id );
+			
+			m.queue( batch->queue() );
+			return;
+		}
+		
 		send_link_request( out, src_path, src_path_size,
 		                        dst_path, dst_path_size );
 		
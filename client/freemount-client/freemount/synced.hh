@@ -6,12 +6,20 @@
 #ifndef FREEMOUNT_SYNCED_HH
 #define FREEMOUNT_SYNCED_HH
 
+// Standard C++
+#include <vector>
+
 // Standard C
 #include <stdint.h>
 
 // plus
 #include "plus/string.hh"
 
+// freemount
+#include "freemount/frame.hh"
+#include "freemount/frame_size.hh"
+#include "freemount/send_queue.hh"
+
 
 namespace freemount
 {
@@ -53,6 +61,59 @@ namespace freemount
 		}
 	};
 	
+	/*
+		While a synced_batch is in scope, synced_open(), synced_put(),
+		synced_pwrite() and synced_link() calls on its output don't wait
+		for their results.  Each request is queued with its own request id,
+		and finish() sends them all in one flush, then collects the results
+		and throws a path_error for the earliest request that failed.  So a
+		script that builds a UI costs one round trip instead of dozens.
+		
+		Since the results arrive later, synced_open() returns chosen_fd
+		without knowing whether the open succeeded, and errors surface only
+		at finish().  The requests' data is copied, so temporaries are fine.
+		Other synced_* calls on the same output (and writes too large for
+		one frame) finish the batch first.  The destructor finishes it too
+		(unless an exception is propagating), but discards any error, so
+		call finish() explicitly.
+	*/
+	
+	class synced_batch
+	{
+		private:
+			int its_in;
+			int its_out;
+			
+			send_queue  its_queue;
+			
+			std::vector< plus::string > its_paths;  // indexed by r_id - 1
+			
+			unsigned  its_n_pending;
+			uint16_t  its_failed_id;
+			int       its_error;
+			
+			synced_batch* its_outer;
+			
+			static int frame_handler( void* that, const frame_header& frame );
+			
+			// non-copyable
+			synced_batch           ( const synced_batch& );
+			synced_batch& operator=( const synced_batch& );
+		
+		public:
+			synced_batch( int in, int out );
+			
+			~synced_batch();
+			
+			static synced_batch* active( int out );
+			
+			send_queue& queue()  { return its_queue; }
+			
+			uint16_t next_request( const char* path, uint32_t path_size );
+			
+			void finish();
+	};
+	
 	// Functions
 	
 	typedef void (*dirent_callback)( const char* name, uint32_t size, void* x );
@@ -65,12 +126,18 @@ namespace freemount
 	
 	plus::string synced_get( int in, int out, const plus::string& path );
 	
+	/*
+		As with send_write_request(), pass a max_payload larger than
+		max_plain_payload only if jumbo frames were negotiated.
+	*/
+	
 	void synced_put( int          in,
 	                 int          out,
 	                 const char*  path,
 	                 uint32_t     path_size,
 	                 const char*  data,
-	                 uint32_t     data_size );
+	                 uint32_t     data_size,
+	                 uint32_t     max_payload = max_plain_payload );
 	
 	inline
 	void synced_put( int                  in,
@@ -88,7 +155,8 @@ namespace freemount
 	                    uint32_t     path_size,
 	                    const char*  data,
 	                    uint32_t     data_size,
-	                    uint32_t     offset );
+	                    uint32_t     offset,
+	                    uint32_t     max_payload = max_plain_payload );
 	
 	inline
 	void synced_pwrite( int                  in,
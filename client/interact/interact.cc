@@ -45,6 +45,7 @@
 
 // freemount-client
 #include "freemount/address.hh"
+#include "freemount/seed_waiter.hh"
 #include "freemount/synced.hh"
 
 // interact
@@ -64,16 +65,16 @@
 #define NO_MONOCHROME_LIGHT  "monochrome 'light' rasters aren't yet supported"
 
 #define POLLING_ENSUES  \
-	"GRAPHICS_UPDATE_SIGNAL_FIFO is unset -- will poll every 10ms instead"
-
+	"GRAPHICS_UPDATE_SIGNAL_FIFO is unset -- will wait on the sync seed instead"
+	
 #define MACRELIX_REQUIRED  \
 	"User interaction required.  Please launch MacRelix..."
-
+	
 #define MACRELIX_ACQUIRED  \
 	"Connected to MacRelix.                               "
-
+	
 #define PROMPT( msg )  write( STDERR_FILENO, STR_LEN( PROGRAM ": " msg ) )
-
+	
 #define ERROR( msg )  write( STDERR_FILENO, STR_LEN( PROGRAM ": " msg "\n" ) )
 
 namespace p7 = poseven;
@@ -93,15 +94,17 @@ enum
 	Opt_last_byte = 255,
 	
 	Opt_raster,
+	Opt_coalesce,
 };
 
 static command::option options[] =
 {
-	{ "gui",     Opt_gui,     command::Param_required },
-	{ "mnt",     Opt_mnt,     command::Param_required },
-	{ "raster",  Opt_raster,  command::Param_required },
-	{ "title",   Opt_title,   command::Param_required },
-	{ "magnify", Opt_magnify, command::Param_required },
+	{ "coalesce", Opt_coalesce                          },
+	{ "gui",      Opt_gui,      command::Param_required },
+	{ "mnt",      Opt_mnt,      command::Param_required },
+	{ "raster",   Opt_raster,   command::Param_required },
+	{ "title",    Opt_title,    command::Param_required },
+	{ "magnify",  Opt_magnify,  command::Param_required },
 	{ NULL }
 };
 
@@ -124,10 +127,10 @@ static raster::raster_load loaded_raster;
 
 #define OPEN( path )  \
 	synced_open( protocol_in, protocol_out, next_fd++, STR_LEN( path ) )
-
+	
 #define PUT( path, data, size )  \
 	synced_put( protocol_in, protocol_out, STR_LEN( path ), data, size )
-
+	
 #define LINK( src, dst )  \
 	synced_link( protocol_in, protocol_out, STR_LEN( src ), STR_LEN( dst ) )
 
@@ -210,6 +213,10 @@ char* const* get_options( char** argv )
 		
 		switch ( opt )
 		{
+			case Opt_coalesce:
+				coalescing_motion = true;
+				break;
+			
 			case Opt_gui:
 				gui_path = global_result.param;
 				break;
@@ -305,6 +312,8 @@ void update_loop( raster::sync_relay*  sync,
 	
 	char* image = buffer.reset( image_size );
 	
+	seed_waiter waiter;
+	
 	uint32_t seed = 0;
 	
 	while ( sync->status == raster::Sync_ready )
@@ -313,11 +322,17 @@ void update_loop( raster::sync_relay*  sync,
 		{
 			if ( update_fifo )
 			{
+				/*
+					Opening the FIFO for writing blocks until the producer
+					opens it for reading, which it does after each update.
+					The open() is the wait, so it's repeated every time.
+				*/
+				
 				close( open( update_fifo, O_WRONLY ) );
 			}
 			else
 			{
-				usleep( 10000 );  // 10ms
+				waiter.wait( &sync->seed, seed );
 			}
 			
 			poseven::thread::testcancel();
@@ -584,6 +599,14 @@ int main( int argc, char** argv )
 	}
 	
 	raster_update_thread.cancel( NULL );
+	
+	if ( raster_path )
+	{
+		// Don't wait out the seed_waiter's timeout.
+		
+		wake_seed_waiters( &sync->seed );
+	}
+	
 	raster_update_thread.join();
 	
 	return exit_status;
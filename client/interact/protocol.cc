@@ -8,9 +8,13 @@
 // POSIX
 #include <unistd.h>
 
+// Standard C++
+#include <vector>
+
 // Standard C
 #include <errno.h>
 #include <stdlib.h>
+#include <string.h>
 
 // freemount
 #include "freemount/event_loop.hh"
@@ -24,6 +28,67 @@ using namespace freemount;
 unsigned x_numerator   = 1;
 unsigned x_denominator = 1;
 
+bool coalescing_motion;
+
+
+/*
+	Events are written to stdout once per received batch, rather than
+	once per frame.  When coalescing, a mouse motion event replaces a
+	motion event immediately before it in the same batch, so a burst of
+	motion delivers only the latest position.  (A motion event after a
+	click or keystroke is kept, so those still see where they happened.)
+*/
+
+const uint8_t motion_event = 5;
+
+const size_t motion_event_size = 6;
+
+static std::vector< char > pending_events;
+
+static size_t last_event;  // offset in pending_events
+static bool   ends_in_motion;
+
+static
+void queue_event( const uint8_t* data, size_t size )
+{
+	const bool motion = size == motion_event_size  &&  data[ 0 ] == motion_event;
+	
+	const size_t end = pending_events.size();
+	
+	if ( motion  &&  coalescing_motion  &&  ends_in_motion )
+	{
+		memcpy( &pending_events[ last_event ], data, size );
+		
+		return;
+	}
+	
+	pending_events.insert( pending_events.end(), data, data + size );
+	
+	last_event     = end;
+	ends_in_motion = motion;
+}
+
+static
+void flush_events()
+{
+	if ( ! pending_events.empty() )
+	{
+		write( STDOUT_FILENO, &pending_events[ 0 ], pending_events.size() );
+		
+		pending_events.clear();
+	}
+	
+	ends_in_motion = false;
+}
+
+static
+int batch_end( void* )
+{
+	flush_events();
+	
+	return 0;
+}
+
 struct request_status
 {
 	ssize_t result;
@@ -34,10 +99,12 @@ int wait_for_result( int fd, frame_handler_function handler )
 {
 	request_status req;
 	
-	data_receiver r( handler, &req );
+	data_receiver r( handler, &req, &batch_end );
 	
 	int looped = run_event_loop( r, fd );
 	
+	flush_events();
+	
 	if ( looped < 0  ||  (looped == 0  &&  (looped = -ECONNRESET)) )
 	{
 		return looped;
@@ -84,7 +151,7 @@ int frame_handler( void* that, const frame_header& frame )
 			data = (const uint8_t*) buffer;
 		}
 		
-		write( STDOUT_FILENO, data, get_size( frame ) );
+		queue_event( data, get_size( frame ) );
 		return 0;
 	}
 	
@@ -9,6 +9,8 @@
 extern unsigned x_numerator;
 extern unsigned x_denominator;
 
+extern bool coalescing_motion;
+
 int run_event_loop( int protocol_in );
 
 #endif
@@ -0,0 +1,69 @@
+/*
+	freemount/block_sums.cc
+	-----------------------
+*/
+
+#include "freemount/block_sums.hh"
+
+// Standard C
+#include <string.h>
+
+// iota
+#include "iota/endian.hh"
+
+
+namespace freemount
+{
+	
+	void encode_block_sum( char* p, const block_sum& sum )
+	{
+		const uint32_t weak   = iota::big_u32( sum.weak   );
+		const uint64_t strong = iota::big_u64( sum.strong );
+		
+		memcpy( p,                 &weak,   sizeof weak   );
+		memcpy( p + sizeof weak,   &strong, sizeof strong );
+	}
+	
+	void decode_block_sum( const char* p, block_sum& sum )
+	{
+		uint32_t weak;
+		uint64_t strong;
+		
+		memcpy( &weak,   p,               sizeof weak   );
+		memcpy( &strong, p + sizeof weak, sizeof strong );
+		
+		sum.weak   = iota::u32_from_big( weak   );
+		sum.strong = iota::u64_from_big( strong );
+	}
+	
+	uint64_t strong_sum( const char* data, size_t n )
+	{
+		uint64_t hash = 0xcbf29ce484222325ull;
+		
+		const uint8_t* p = (const uint8_t*) data;
+		
+		while ( n-- > 0 )
+		{
+			hash ^= *p++;
+			hash *= 0x100000001b3ull;
+		}
+		
+		return hash;
+	}
+	
+	rolling_sum::rolling_sum( const char* data, size_t n )
+	:
+		its_a(),
+		its_b(),
+		its_length( n )
+	{
+		const uint8_t* p = (const uint8_t*) data;
+		
+		for ( size_t i = 0;  i < n;  ++i )
+		{
+			its_a += p[ i ];
+			its_b += (n - i) * p[ i ];
+		}
+	}
+	
+}
@@ -0,0 +1,83 @@
+/*
+	freemount/block_sums.hh
+	-----------------------
+*/
+
+#ifndef FREEMOUNT_BLOCKSUMS_HH
+#define FREEMOUNT_BLOCKSUMS_HH
+
+// Standard C
+#include <stddef.h>
+#include <stdint.h>
+
+
+namespace freemount
+{
+	
+	/*
+		Block checksums for delta transfers.  A sums request returns, for
+		each block of a file, a weak checksum (the rsync rolling sum) and a
+		strong one (64-bit FNV-1a).  The weak sum of a window can be updated
+		in constant time as it slides by one byte, so a client can find the
+		server's blocks anywhere in its own copy, and confirm candidates
+		with the strong sum.
+		
+		Each Frame_block_sums payload is an array of encoded block_sums, in
+		block order.  The last block may be shorter than the block size.
+	*/
+	
+	const uint32_t default_sums_block_size = 16384;
+	const uint32_t min_sums_block_size     = 512;
+	const uint32_t max_sums_block_size     = 1 << 20;  // 1 MiB
+	
+	struct block_sum
+	{
+		uint32_t  weak;
+		uint64_t  strong;
+	};
+	
+	const size_t encoded_block_sum_size = 12;
+	
+	void encode_block_sum( char* p, const block_sum& sum );
+	void decode_block_sum( const char* p, block_sum& sum );
+	
+	uint64_t strong_sum( const char* data, size_t n );
+	
+	class rolling_sum
+	{
+		private:
+			uint32_t  its_a;
+			uint32_t  its_b;
+			uint32_t  its_length;
+		
+		public:
+			rolling_sum( const char* data, size_t n );
+			
+			uint32_t get() const  { return (its_a & 0xFFFF) | its_b << 16; }
+			
+			// Slide the window by one byte, dropping out and adding in.
+			
+			void roll( uint8_t out, uint8_t in )
+			{
+				its_a += in - out;
+				its_b += its_a - its_length * out;
+			}
+	};
+	
+	inline
+	uint32_t weak_sum( const char* data, size_t n )
+	{
+		return rolling_sum( data, n ).get();
+	}
+	
+	inline
+	block_sum get_block_sum( const char* data, size_t n )
+	{
+		const block_sum sum = { weak_sum( data, n ), strong_sum( data, n ) };
+		
+		return sum;
+	}
+	
+}
+
+#endif
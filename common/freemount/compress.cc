@@ -0,0 +1,405 @@
+/*
+	freemount/compress.cc
+	---------------------
+*/
+
+#include "freemount/compress.hh"
+
+// POSIX
+#include <time.h>
+
+// Standard C
+#include <string.h>
+
+// iota
+#include "iota/endian.hh"
+
+// freemount
+#include "freemount/frame.hh"
+#include "freemount/queue_utils.hh"
+
+
+namespace freemount
+{
+	
+	/*
+		The compressor is a plain greedy LZ4 block encoder with a small hash
+		table.  It favors speed over ratio, since it runs once per block
+		of file data sent.
+	*/
+	
+	enum
+	{
+		hash_bits     = 12,
+		min_match     = 4,
+		last_literals = 5,   // the block must end with 5 literal bytes
+		match_margin  = 12,  // and its last match must start before these
+		
+		min_input_size = 64,
+		sample_size    = 1024,
+	};
+	
+	static inline
+	uint32_t read_32( const char* p )
+	{
+		uint32_t x;
+		
+		memcpy( &x, p, sizeof x );
+		
+		return x;
+	}
+	
+	static inline
+	unsigned hash( uint32_t x )
+	{
+		return x * 2654435761u >> (32 - hash_bits);
+	}
+	
+	static inline
+	char* put_length( char* op, size_t n )
+	{
+		// Called for lengths of 15 or more; the token holds the first 15.
+		
+		for ( n -= 15;  n >= 255;  n -= 255 )
+		{
+			*op++ = char( 255 );
+		}
+		
+		*op++ = char( n );
+		
+		return op;
+	}
+	
+	static
+	char* put_sequence( char*        op,
+	                    const char*  op_end,
+	                    const char*  literals,
+	                    size_t       n_literals,
+	                    size_t       offset,
+	                    size_t       match_length )  // excluding min_match
+	{
+		const size_t worst_case = 1 + n_literals / 255 + 1
+		                        + n_literals
+		                        + 2 + match_length / 255 + 1;
+		
+		if ( worst_case > size_t( op_end - op ) )
+		{
+			return NULL;
+		}
+		
+		const bool last = offset == 0;
+		
+		char* token = op++;
+		
+		*token = (n_literals < 15 ? n_literals : 15) << 4;
+		
+		if ( n_literals >= 15 )
+		{
+			op = put_length( op, n_literals );
+		}
+		
+		memcpy( op, literals, n_literals );
+		
+		op += n_literals;
+		
+		if ( last )
+		{
+			return op;
+		}
+		
+		*op++ = char( offset      );
+		*op++ = char( offset >> 8 );
+		
+		*token |= match_length < 15 ? match_length : 15;
+		
+		if ( match_length >= 15 )
+		{
+			op = put_length( op, match_length );
+		}
+		
+		return op;
+	}
+	
+	size_t compress_block( const char* src, size_t n, char* dst, size_t capacity )
+	{
+		uint32_t table[ 1 << hash_bits ] = { 0 };
+		
+		const char* end = src + n;
+		
+		const char* ip     = src;
+		const char* anchor = src;
+		
+		char*       op     = dst;
+		const char* op_end = dst + capacity;
+		
+		if ( n > match_margin )
+		{
+			const char* match_limit = end - match_margin;
+			const char* extend_limit = end - last_literals;
+			
+			while ( ip < match_limit )
+			{
+				const uint32_t seq = read_32( ip );
+				
+				uint32_t& slot = table[ hash( seq ) ];
+				
+				const char* ref = src + slot;
+				
+				slot = ip - src;
+				
+				if ( ref >= ip  ||  ip - ref > 0xFFFF  ||  read_32( ref ) != seq )
+				{
+					++ip;
+					continue;
+				}
+				
+				const char* p = ip  + min_match;
+				const char* q = ref + min_match;
+				
+				while ( p < extend_limit  &&  *p == *q )
+				{
+					++p;
+					++q;
+				}
+				
+				op = put_sequence( op, op_end,
+				                   anchor, ip - anchor,
+				                   ip - ref, p - ip - min_match );
+				
+				if ( op == NULL )
+				{
+					return 0;
+				}
+				
+				ip = anchor = p;
+			}
+		}
+		
+		op = put_sequence( op, op_end, anchor, end - anchor, 0, 0 );
+		
+		if ( op == NULL )
+		{
+			return 0;
+		}
+		
+		const size_t size = op - dst;
+		
+		return size < n ? size : 0;
+	}
+	
+	static inline
+	bool get_length( const uint8_t*& ip, const uint8_t* end, size_t& n )
+	{
+		uint8_t b;
+		
+		do
+		{
+			if ( ip == end )
+			{
+				return false;
+			}
+			
+			n += b = *ip++;
+		}
+		while ( b == 255 );
+		
+		return true;
+	}
+	
+	long decompress_block( const char* src, size_t n, char* dst, size_t capacity )
+	{
+		const uint8_t* ip  = (const uint8_t*) src;
+		const uint8_t* end = ip + n;
+		
+		char*       op     = dst;
+		const char* op_end = dst + capacity;
+		
+		while ( ip < end )
+		{
+			const uint8_t token = *ip++;
+			
+			size_t n_literals = token >> 4;
+			
+			if ( n_literals == 15  &&  ! get_length( ip, end, n_literals ) )
+			{
+				return -1;
+			}
+			
+			if ( n_literals > size_t( end    - ip )  ||
+			     n_literals > size_t( op_end - op ) )
+			{
+				return -1;
+			}
+			
+			memcpy( op, ip, n_literals );
+			
+			op += n_literals;
+			ip += n_literals;
+			
+			if ( ip == end )
+			{
+				break;  // the last sequence has no match
+			}
+			
+			if ( end - ip < 2 )
+			{
+				return -1;
+			}
+			
+			const size_t offset = ip[ 0 ] | ip[ 1 ] << 8;
+			
+			ip += 2;
+			
+			if ( offset == 0  ||  offset > size_t( op - dst ) )
+			{
+				return -1;
+			}
+			
+			size_t match_length = token & 0xF;
+			
+			if ( match_length == 15  &&  ! get_length( ip, end, match_length ) )
+			{
+				return -1;
+			}
+			
+			match_length += min_match;
+			
+			if ( match_length > size_t( op_end - op ) )
+			{
+				return -1;
+			}
+			
+			// Copy bytewise, since the match may overlap its own output.
+			
+			const char* ref = op - offset;
+			
+			while ( match_length-- > 0 )
+			{
+				*op++ = *ref++;
+			}
+		}
+		
+		return op - dst;
+	}
+	
+	bool looks_incompressible( const char* src, size_t n )
+	{
+		/*
+			The sum of squared byte counts is n^2 times the chance that two
+			sampled bytes match.  For uniformly random bytes that's 1/256;
+			text and most binaries are well above 2/256.
+		*/
+		
+		if ( n > sample_size )
+		{
+			src += (n - sample_size) / 2;  // skip any header
+			n    = sample_size;
+		}
+		
+		uint32_t counts[ 256 ] = { 0 };
+		
+		for ( size_t i = 0;  i < n;  ++i )
+		{
+			++counts[ (uint8_t) src[ i ] ];
+		}
+		
+		uint64_t sum_of_squares = 0;
+		
+		for ( int i = 0;  i < 256;  ++i )
+		{
+			sum_of_squares += counts[ i ] * counts[ i ];
+		}
+		
+		return sum_of_squares * 256 < 2 * uint64_t( n ) * n;
+	}
+	
+	uint8_t compressed_frame_type( uint8_t type )
+	{
+		return type == Frame_recv_data ? uint8_t( Frame_recv_zdata )
+		     : type == Frame_send_data ? uint8_t( Frame_send_zdata )
+		     :                           type;
+	}
+	
+	uint8_t plain_frame_type( uint8_t type )
+	{
+		return type == Frame_recv_zdata ? uint8_t( Frame_recv_data )
+		     : type == Frame_send_zdata ? uint8_t( Frame_send_data )
+		     :                            type;
+	}
+	
+	static inline
+	uint64_t thread_cpu_usecs()
+	{
+	#ifdef CLOCK_THREAD_CPUTIME_ID
+		
+		timespec ts;
+		
+		if ( clock_gettime( CLOCK_THREAD_CPUTIME_ID, &ts ) == 0 )
+		{
+			return ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+		}
+		
+	#endif
+		
+		return 0;
+	}
+	
+	void data_compressor::queue( send_queue&  queue,
+	                             uint8_t      type,
+	                             const char*  data,
+	                             uint32_t     size,
+	                             uint16_t     r_id )
+	{
+		its_stats.n_bytes_in += size;
+		
+		size_t packed_size = 0;
+		
+		if ( size >= min_input_size )
+		{
+			const uint64_t t0 = thread_cpu_usecs();
+			
+			if ( looks_incompressible( data, size ) )
+			{
+				++its_stats.n_frames_skipped;
+			}
+			else
+			{
+				const uint32_t header = sizeof (uint32_t);
+				
+				if ( its_buffer.size() < header + size )
+				{
+					its_buffer.resize( header + size );
+				}
+				
+				char* buffer = &its_buffer[ 0 ];
+				
+				const uint32_t big_size = iota::big_u32( size );
+				
+				memcpy( buffer, &big_size, sizeof big_size );
+				
+				packed_size = compress_block( data, size, buffer + header, size - header );
+				
+				if ( packed_size )
+				{
+					packed_size += header;
+				}
+			}
+			
+			its_stats.cpu_usecs += thread_cpu_usecs() - t0;
+		}
+		
+		if ( packed_size )
+		{
+			++its_stats.n_frames_packed;
+			
+			type = compressed_frame_type( type );
+			data = &its_buffer[ 0 ];
+			size = packed_size;
+		}
+		
+		its_stats.n_bytes_out += size;
+		
+		queue_data( queue, type, data, size, r_id );
+	}
+	
+}
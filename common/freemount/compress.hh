@@ -0,0 +1,91 @@
+/*
+	freemount/compress.hh
+	---------------------
+*/
+
+#ifndef FREEMOUNT_COMPRESS_HH
+#define FREEMOUNT_COMPRESS_HH
+
+// Standard C++
+#include <vector>
+
+// Standard C
+#include <stddef.h>
+#include <stdint.h>
+
+
+namespace freemount
+{
+	
+	class send_queue;
+	
+	/*
+		Data frame compression, enabled per session by Feature_compression.
+		
+		A compressed frame (Frame_send_zdata or Frame_recv_zdata) carries the
+		uncompressed size (32 bits, big-endian) followed by an LZ4 block.  The
+		receiver decodes it back into an ordinary data frame (see receiver.hh)
+		so frame handlers never see the difference.
+		
+		compress_block() returns the compressed size, or zero if the result
+		wouldn't be smaller than the input (or wouldn't fit in dst).
+		
+		decompress_block() returns the decompressed size, or -1 if the input
+		is malformed or would overflow dst.
+		
+		looks_incompressible() checks a sample of the data for a nearly flat
+		byte distribution, as found in data that's already compressed (or
+		encrypted), so we don't waste time trying to compress it again.
+	*/
+	
+	size_t compress_block( const char* src, size_t n, char* dst, size_t capacity );
+	
+	long decompress_block( const char* src, size_t n, char* dst, size_t capacity );
+	
+	bool looks_incompressible( const char* src, size_t n );
+	
+	uint8_t compressed_frame_type( uint8_t type );
+	uint8_t plain_frame_type     ( uint8_t type );
+	
+	struct compression_stats
+	{
+		uint64_t  n_bytes_in;       // payload bytes offered
+		uint64_t  n_bytes_out;      // payload bytes sent
+		uint32_t  n_frames_packed;  // frames sent compressed
+		uint32_t  n_frames_skipped; // incompressible frames sent as is
+		uint64_t  cpu_usecs;        // time spent compressing
+	};
+	
+	/*
+		A data_compressor queues data frames, compressed when it pays off.
+		Like queue_data(), it references the payload (or its own buffer),
+		so flush the queue before calling queue() again.
+	*/
+	
+	class data_compressor
+	{
+		private:
+			std::vector< char >  its_buffer;
+			compression_stats    its_stats;
+			
+			// non-copyable
+			data_compressor           ( const data_compressor& );
+			data_compressor& operator=( const data_compressor& );
+		
+		public:
+			data_compressor() : its_stats()
+			{
+			}
+			
+			const compression_stats& stats() const  { return its_stats; }
+			
+			void queue( send_queue&  queue,
+			            uint8_t      type,
+			            const char*  data,
+			            uint32_t     size,
+			            uint16_t     r_id );
+	};
+	
+}
+
+#endif
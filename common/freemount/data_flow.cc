@@ -22,7 +22,6 @@ namespace freemount
 		the_congestion_window = n_bytes;
 	}
 	
-	static inline
 	long get_congestion_window()
 	{
 	#ifdef __RELIX__
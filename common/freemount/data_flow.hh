@@ -10,8 +10,16 @@
 namespace freemount
 {
 	
+	/*
+		The congestion window limits the data in flight (sent but not yet
+		acknowledged) for the whole process, not per request, since acks
+		don't say which request's data they're for.
+	*/
+	
 	void set_congestion_window( long n_bytes );
 	
+	long get_congestion_window();  // zero if unlimited
+	
 	void data_transmitting( unsigned n_bytes );
 	void data_acknowledged( unsigned n_bytes );
 	
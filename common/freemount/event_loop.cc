@@ -18,11 +18,21 @@
 namespace freemount
 {
 	
+#ifdef __RELIX__
+	
+	const size_t recv_buffer_size = 4096;
+	
+#else
+	
+	const size_t recv_buffer_size = 32768;
+	
+#endif
+	
 	int run_event_loop( data_receiver& r, int fd )
 	{
 		for ( ;; )
 		{
-			char buffer[ 4096 ];
+			char buffer[ recv_buffer_size ];
 			
 			const ssize_t n_read = read( fd, &buffer, sizeof buffer );
 			
@@ -46,5 +56,19 @@ namespace freemount
 		}
 	}
 	
+	int receive_batch( data_receiver& r, int fd )
+	{
+		char buffer[ recv_buffer_size ];
+		
+		const ssize_t n_read = read( fd, &buffer, sizeof buffer );
+		
+		if ( n_read > 0 )
+		{
+			return r.recv_bytes( buffer, n_read );
+		}
+		
+		return n_read == 0 ? -ECONNRESET : -errno;
+	}
+	
 }
 
@@ -14,6 +14,13 @@ namespace freemount
 	
 	int run_event_loop( data_receiver& r, int fd );
 	
+	/*
+		receive_batch() reads once from fd and passes the data to r.  It
+		returns r's status, -errno on error, or -ECONNRESET at end of file.
+	*/
+	
+	int receive_batch( data_receiver& r, int fd );
+	
 }
 
 #endif
@@ -33,11 +33,16 @@ namespace freemount
 		const int big_sizeof_32 = iota::big_u16( sizeof (uint32_t) );
 		const int big_sizeof_64 = iota::big_u16( sizeof (uint64_t) );
 		
-		if ( frame.big_size == 0 )
+		if ( ! has_payload( frame ) )
 		{
 			return frame.data;
 		}
 		
+		if ( frame._0 != 0 )
+		{
+			throw bad_integer_size();
+		}
+		
 		if ( frame.big_size == big_sizeof_32 )
 		{
 			return iota::u32_from_big( *(uint32_t*) get_payload_data( frame ) );
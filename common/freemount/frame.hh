@@ -15,13 +15,13 @@ namespace freemount
 	
 	struct frame_header
 	{
-		uint8_t   _0;
+		uint8_t   _0;    // payload size high byte, with jumbo frames
 		uint8_t   type;  // frame type
 		uint16_t  big_size;
 		
 		uint8_t   c_id;  // chain id
 		uint8_t   r_id;  // request id
-		uint8_t   _6;
+		uint8_t   _6;    // request id high byte, with wide ids
 		uint8_t   data;  // request type
 	};
 	
@@ -34,11 +34,17 @@ namespace freemount
 		return &frame + 1;
 	}
 	
+	inline
+	bool has_payload( const frame_header& frame )
+	{
+		return frame.big_size != 0  ||  frame._0 != 0;
+	}
+	
 	inline
 	const void* get_data( const frame_header& frame )
 	{
-		return frame.big_size != 0 ? get_payload_data( frame )
-		                           : &frame.data;
+		return has_payload( frame ) ? get_payload_data( frame )
+		                            : &frame.data;
 	}
 	
 	inline
@@ -47,6 +53,25 @@ namespace freemount
 		return (const char*) get_data( frame );
 	}
 	
+	/*
+		Request ids are 16 bits wide, with the high byte in _6.  Peers that
+		haven't negotiated Feature_wide_ids only use ids up to 255, leaving
+		_6 zero, which is how the protocol has always been encoded.
+	*/
+	
+	inline
+	uint16_t get_request_id( const frame_header& frame )
+	{
+		return frame._6 << 8 | frame.r_id;
+	}
+	
+	inline
+	void set_request_id( frame_header& frame, uint16_t r_id )
+	{
+		frame.r_id = uint8_t( r_id );
+		frame._6   = uint8_t( r_id >> 8 );
+	}
+	
 	uint32_t get_u32( const frame_header& frame );
 	uint64_t get_u64( const frame_header& frame );
 	
@@ -71,6 +96,8 @@ namespace freemount
 		Frame_submit  = 1,
 		Frame_cancel  = 2,
 		
+		Frame_arg_features = 3,  // vers:  feature bits requested
+		
 		Frame_arg_path = 4,
 		
 		Frame_arg_fd = 6,
@@ -78,19 +105,31 @@ namespace freemount
 		Frame_send_data   = 8,
 		Frame_io_count    = 9,  // read() limit, write() total
 		Frame_seek_offset = 10,
+		Frame_send_zdata  = 11,  // compressed send_data
+		Frame_block_size  = 12,  // sums:  checksum block size
 		
 		// message frames (responses)
 		
 		Frame_accept = 64 + 0,
 		Frame_result = 64 + 1,
 		
+		Frame_features    = 64 + 3,  // vers:  feature bits granted
+		Frame_max_payload = 64 + 4,  // vers:  largest payload either way
+		Frame_window      = 64 + 5,  // vers:  server's congestion window
+		
 		Frame_dentry_name = 64 + 7,
 		
-		Frame_recv_data = 64 + 8,
+		Frame_recv_data  = 64 + 8,
+		Frame_recv_zdata = 64 + 9,  // compressed recv_data
+		
+		Frame_block_sums = 64 + 10,  // see block_sums.hh
+		
+		Frame_watch_event = 64 + 11,  // name of changed entry, or empty
 		
 		Frame_stat_mode  = 64 + 18,
 		Frame_stat_nlink = 64 + 19,
 		Frame_stat_size  = 64 + 23,
+		Frame_stat_mtime = 64 + 27,  // nanoseconds; needs Feature_stat_mtime
 	};
 	
 	enum request_type
@@ -104,10 +143,35 @@ namespace freemount
 		req_open  = 7,
 		req_close = 8,
 		req_link = 9,
+		req_sums = 10,
+		req_watch = 11,
 		
 		req_none = 0
 	};
 	
+	/*
+		Optional protocol features, negotiated with a vers request:  The
+		client sends the bits it wants and the server replies with the ones
+		it grants, along with its frame size limit and congestion window.
+		A feature may be used only once it's been granted.
+		
+		Servers predating vers treat it as an unknown request and drop the
+		connection, so a client first sends a Frame_ping with a nonzero data
+		byte.  Newer servers answer with protocol_version in the pong's data
+		byte; older ones, with zero.
+	*/
+	
+	const uint8_t protocol_version = 1;
+	
+	enum feature_bit
+	{
+		Feature_wide_ids     = 1 << 0,  // 16-bit request ids
+		Feature_jumbo_frames = 1 << 1,  // 24-bit payload sizes
+		Feature_compression  = 1 << 2,  // compressed data frames
+		Feature_batching     = 1 << 3,  // pipelined requests answered together
+		Feature_stat_mtime   = 1 << 4,  // stat sends Frame_stat_mtime
+	};
+	
 }
 
 
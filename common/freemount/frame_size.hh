@@ -19,17 +19,48 @@
 namespace freemount
 {
 	
+	/*
+		Payload sizes are 16 bits, unless Feature_jumbo_frames has been
+		negotiated, in which case _0 supplies the high eight bits.  Even
+		then, receivers reject payloads larger than max_jumbo_payload, so
+		each frame they buffer is bounded.
+	*/
+	
+	const uint32_t max_plain_payload = 0xFFFF;   // 65535
+	const uint32_t max_jumbo_payload = 1 << 20;  // 1 MiB
+	
+	inline
+	uint32_t get_payload_size( const frame_header& frame )
+	{
+		return frame._0 << 16 | iota::u16_from_big( frame.big_size );
+	}
+	
+	inline
+	void set_payload_size( frame_header& frame, uint32_t size )
+	{
+		frame._0       = uint8_t( size >> 16 );
+		frame.big_size = iota::big_u16( uint16_t( size ) );
+	}
+	
+	inline
+	uint32_t get_size( const frame_header& frame )
+	{
+		return has_payload( frame ) ? get_payload_size( frame )
+		                            : frame.data != 0;
+	}
+	
+	// The size of the whole frame, including header and padding
+	
 	inline
-	uint16_t get_payload_size( const frame_header& frame )
+	uint32_t get_frame_size( const frame_header& frame )
 	{
-		return iota::u16_from_big( frame.big_size );
+		return sizeof (frame_header) + ((get_payload_size( frame ) + 3) & ~3);
 	}
 	
 	inline
-	uint16_t get_size( const frame_header& frame )
+	const frame_header* next_frame( const frame_header& frame )
 	{
-		return frame.big_size != 0 ? get_payload_size( frame )
-		                           : frame.data != 0;
+		return (const frame_header*) ((const char*) &frame + get_frame_size( frame ));
 	}
 	
 }
@@ -0,0 +1,414 @@
+/*
+	freemount/io_ring.cc
+	--------------------
+*/
+
+#include "freemount/io_ring.hh"
+
+// POSIX
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+// Standard C
+#include <errno.h>
+#include <string.h>
+
+// freemount
+#include "freemount/write_in_full.hh"
+
+
+#ifdef __NR_io_uring_setup
+#ifdef __has_include
+#if __has_include( <linux/io_uring.h> )
+#include <linux/io_uring.h>
+#define CONFIG_IO_URING  1
+#endif
+#endif
+#endif
+
+#ifndef CONFIG_IO_URING
+#define CONFIG_IO_URING  0
+#endif
+
+
+namespace freemount
+{
+	
+#if CONFIG_IO_URING
+	
+	struct io_ring::ring
+	{
+		int fd;
+		
+		void*   sq_map;
+		size_t  sq_map_size;
+		void*   cq_map;
+		size_t  cq_map_size;
+		
+		io_uring_sqe*  sqes;
+		size_t         sqes_size;
+		
+		unsigned*  sq_tail;
+		unsigned*  sq_mask;
+		unsigned*  sq_array;
+		
+		unsigned*      cq_head;
+		unsigned*      cq_tail;
+		unsigned*      cq_mask;
+		io_uring_cqe*  cqes;
+	};
+	
+	static inline
+	int io_uring_setup( unsigned entries, io_uring_params* params )
+	{
+		return syscall( __NR_io_uring_setup, entries, params );
+	}
+	
+	static inline
+	int io_uring_enter( int fd, unsigned n_submit, unsigned n_wait )
+	{
+		const unsigned flags = IORING_ENTER_GETEVENTS;
+		
+		return syscall( __NR_io_uring_enter, fd, n_submit, n_wait, flags, NULL, 0 );
+	}
+	
+	static inline
+	void* map_ring( int fd, size_t size, off_t offset )
+	{
+		const int prot  = PROT_READ | PROT_WRITE;
+		const int flags = MAP_SHARED | MAP_POPULATE;
+		
+		void* p = mmap( NULL, size, prot, flags, fd, offset );
+		
+		return p != MAP_FAILED ? p : NULL;
+	}
+	
+	static inline
+	void* offset_by( void* base, uint32_t offset )
+	{
+		return (char*) base + offset;
+	}
+	
+	static
+	void unmap( io_ring::ring& r );
+	
+	io_ring::io_ring() : its_ring(), its_n_prepared()
+	{
+		io_uring_params params;
+		
+		memset( &params, 0, sizeof params );
+		
+		int fd = io_uring_setup( max_tags, &params );
+		
+		if ( fd < 0 )
+		{
+			return;  // ENOSYS, EPERM, etc.
+		}
+		
+		ring* r = new ring();
+		
+		r->fd = fd;
+		
+		r->sq_map_size = params.sq_off.array + params.sq_entries * sizeof (unsigned);
+		r->cq_map_size = params.cq_off.cqes  + params.cq_entries * sizeof (io_uring_cqe);
+		r->sqes_size   = params.sq_entries * sizeof (io_uring_sqe);
+		
+		bool single_map = false;
+		
+#ifdef IORING_FEAT_SINGLE_MMAP
+		
+		if ( params.features & IORING_FEAT_SINGLE_MMAP )
+		{
+			single_map = true;
+			
+			if ( r->cq_map_size > r->sq_map_size )
+			{
+				r->sq_map_size = r->cq_map_size;
+			}
+		}
+		
+#endif
+		
+		r->sq_map = map_ring( fd, r->sq_map_size, IORING_OFF_SQ_RING );
+		
+		r->cq_map = single_map ? r->sq_map
+		                       : map_ring( fd, r->cq_map_size, IORING_OFF_CQ_RING );
+		
+		r->sqes = (io_uring_sqe*) map_ring( fd, r->sqes_size, IORING_OFF_SQES );
+		
+		if ( ! r->sq_map  ||  ! r->cq_map  ||  ! r->sqes )
+		{
+			unmap( *r );
+			
+			delete r;
+			return;
+		}
+		
+		r->sq_tail  = (unsigned*) offset_by( r->sq_map, params.sq_off.tail );
+		r->sq_mask  = (unsigned*) offset_by( r->sq_map, params.sq_off.ring_mask );
+		r->sq_array = (unsigned*) offset_by( r->sq_map, params.sq_off.array );
+		
+		r->cq_head = (unsigned*) offset_by( r->cq_map, params.cq_off.head );
+		r->cq_tail = (unsigned*) offset_by( r->cq_map, params.cq_off.tail );
+		r->cq_mask = (unsigned*) offset_by( r->cq_map, params.cq_off.ring_mask );
+		
+		r->cqes = (io_uring_cqe*) offset_by( r->cq_map, params.cq_off.cqes );
+		
+		its_ring = r;
+	}
+	
+	static
+	void unmap( io_ring::ring& r )
+	{
+		if ( r.sqes )
+		{
+			munmap( r.sqes, r.sqes_size );
+		}
+		
+		if ( r.cq_map  &&  r.cq_map != r.sq_map )
+		{
+			munmap( r.cq_map, r.cq_map_size );
+		}
+		
+		if ( r.sq_map )
+		{
+			munmap( r.sq_map, r.sq_map_size );
+		}
+		
+		close( r.fd );
+	}
+	
+	io_ring::~io_ring()
+	{
+		if ( its_ring )
+		{
+			unmap( *its_ring );
+			
+			delete its_ring;
+		}
+	}
+	
+	static
+	io_uring_sqe& next_sqe( io_ring::ring& r, unsigned tag )
+	{
+		const unsigned index = *r.sq_tail & *r.sq_mask;
+		
+		io_uring_sqe& sqe = r.sqes[ index ];
+		
+		memset( &sqe, 0, sizeof sqe );
+		
+		sqe.user_data = tag;
+		
+		r.sq_array[ index ] = index;
+		
+		return sqe;
+	}
+	
+	void io_ring::prepared()
+	{
+		// Publish the entry only after it's filled in.
+		
+		__atomic_store_n( its_ring->sq_tail, *its_ring->sq_tail + 1, __ATOMIC_RELEASE );
+		
+		++its_n_prepared;
+	}
+	
+	void io_ring::prep_pread( int fd, void* buffer, size_t n, off_t offset, unsigned tag )
+	{
+		if ( ! usable() )
+		{
+			its_results[ tag ] = -ENOSYS;
+			return;
+		}
+		
+		io_uring_sqe& sqe = next_sqe( *its_ring, tag );
+		
+		sqe.opcode = IORING_OP_READV;
+		sqe.fd     = fd;
+		sqe.off    = offset;
+		
+		/*
+			IORING_OP_READ is newer (5.6) than IORING_OP_READV (5.1), so
+			use the latter, with a one-element iovec that outlives run().
+		*/
+		
+		iovec& iov = its_iovecs[ tag ];
+		
+		iov.iov_base = buffer;
+		iov.iov_len  = n;
+		
+		sqe.addr = (uintptr_t) &iov;
+		sqe.len  = 1;
+		
+		prepared();
+	}
+	
+	void io_ring::prep_writev( int fd, const iovec* iov, int n, unsigned tag )
+	{
+		if ( ! usable() )
+		{
+			its_results[ tag ] = -ENOSYS;
+			return;
+		}
+		
+		io_uring_sqe& sqe = next_sqe( *its_ring, tag );
+		
+		sqe.opcode = IORING_OP_WRITEV;
+		sqe.fd     = fd;
+		sqe.off    = uint64_t( -1 );  // the current position, i.e. a stream
+		sqe.addr   = (uintptr_t) iov;
+		sqe.len    = n;
+		
+		prepared();
+	}
+	
+	int io_ring::run()
+	{
+		if ( ! usable() )
+		{
+			return -ENOSYS;  // io_uring_setup() failed
+		}
+		
+		ring& r = *its_ring;
+		
+		unsigned n_submit  = its_n_prepared;
+		unsigned n_pending = its_n_prepared;
+		
+		its_n_prepared = 0;
+		
+		while ( n_pending > 0 )
+		{
+			const int n = io_uring_enter( r.fd, n_submit, n_pending );
+			
+			if ( n < 0 )
+			{
+				if ( errno == EINTR )
+				{
+					continue;
+				}
+				
+				const int err = -errno;
+				
+				for ( unsigned i = 0;  i < max_tags;  ++i )
+				{
+					its_results[ i ] = err;
+				}
+				
+				return err;
+			}
+			
+			n_submit -= n;
+			
+			unsigned head = *r.cq_head;
+			
+			const unsigned tail = __atomic_load_n( r.cq_tail, __ATOMIC_ACQUIRE );
+			
+			while ( head != tail )
+			{
+				const io_uring_cqe& cqe = r.cqes[ head++ & *r.cq_mask ];
+				
+				its_results[ cqe.user_data ] = cqe.res;
+				
+				--n_pending;
+			}
+			
+			__atomic_store_n( r.cq_head, head, __ATOMIC_RELEASE );
+		}
+		
+		return 0;
+	}
+	
+#else
+	
+	struct io_ring::ring {};
+	
+	io_ring::io_ring() : its_ring(), its_n_prepared()
+	{
+	}
+	
+	io_ring::~io_ring()
+	{
+	}
+	
+	void io_ring::prepared()
+	{
+	}
+	
+	void io_ring::prep_pread( int, void*, size_t, off_t, unsigned tag )
+	{
+		its_results[ tag ] = -ENOSYS;
+	}
+	
+	void io_ring::prep_writev( int, const iovec*, int, unsigned tag )
+	{
+		its_results[ tag ] = -ENOSYS;
+	}
+	
+	int io_ring::run()
+	{
+		return -ENOSYS;
+	}
+	
+#endif
+	
+	void io_ring::writev_in_full( int fd, iovec* iov, int n )
+	{
+		if ( ! usable() )
+		{
+			freemount::writev_in_full( fd, iov, n );
+			return;
+		}
+		
+		size_t total = 0;
+		
+		for ( int i = 0;  i < n;  ++i )
+		{
+			total += iov[ i ].iov_len;
+		}
+		
+		const unsigned tag = max_tags - 1;
+		
+		prep_writev( fd, iov, n, tag );
+		
+		run();
+		
+		const int n_written = result( tag );
+		
+		if ( n_written >= 0  &&  size_t( n_written ) == total )
+		{
+			return;
+		}
+		
+		if ( n_written < 0  &&  n_written != -EAGAIN )
+		{
+			failed_write error = { -n_written };
+			
+			throw error;
+		}
+		
+		/*
+			A short write (or a non-blocking socket that's full) leaves the
+			rest to the ordinary path, which waits for the socket as needed.
+		*/
+		
+		size_t skip = n_written > 0 ? n_written : 0;
+		
+		while ( skip >= iov->iov_len )
+		{
+			skip -= iov->iov_len;
+			
+			++iov;
+			--n;
+		}
+		
+		iov->iov_base = (char*) iov->iov_base + skip;
+		iov->iov_len -= skip;
+		
+		freemount::writev_in_full( fd, iov, n );
+	}
+	
+}
@@ -0,0 +1,80 @@
+/*
+	freemount/io_ring.hh
+	--------------------
+*/
+
+#ifndef FREEMOUNT_IORING_HH
+#define FREEMOUNT_IORING_HH
+
+// POSIX
+#include <sys/types.h>
+#include <sys/uio.h>
+
+// Standard C
+#include <stdint.h>
+
+
+namespace freemount
+{
+	
+	/*
+		An io_ring hands several I/O operations to the kernel at once, using
+		Linux's io_uring, so that (for example) sending one block of a file
+		and reading the next costs one system call instead of two.
+		
+		Whether io_uring works is known only at run time -- the kernel may
+		predate it, or policy may disable it -- so check usable(), and make
+		ordinary system calls if it's false.  Elsewhere it's always false.
+		
+		prep_pread() and prep_writev() prepare operations, each identified
+		by a tag less than max_tags, and run() submits everything prepared
+		and waits for all of it to complete, returning zero or a negative
+		errno value.  Afterward, result() is the operation's byte count or
+		negative errno value.  Buffers and iovecs must remain valid until
+		run() returns.
+		
+		writev_in_full() is like the function of that name, but submits the
+		write along with whatever else is prepared.  It uses the last tag.
+	*/
+	
+	class io_ring
+	{
+		public:
+			static const unsigned max_tags = 4;
+			
+			struct ring;  // opaque
+		
+		private:
+			ring*     its_ring;
+			unsigned  its_n_prepared;
+			int       its_results[ max_tags ];
+			iovec     its_iovecs [ max_tags ];  // for prep_pread()
+			
+			void prepared();
+			
+			// non-copyable
+			io_ring           ( const io_ring& );
+			io_ring& operator=( const io_ring& );
+		
+		public:
+			io_ring();
+			~io_ring();
+			
+			bool usable() const  { return its_ring != 0; }
+			
+			unsigned n_prepared() const  { return its_n_prepared; }
+			
+			void prep_pread( int fd, void* buffer, size_t n, off_t offset, unsigned tag );
+			
+			void prep_writev( int fd, const iovec* iov, int n, unsigned tag );
+			
+			int run();
+			
+			int result( unsigned tag ) const  { return its_results[ tag ]; }
+			
+			void writev_in_full( int fd, iovec* iov, int n );
+	};
+	
+}
+
+#endif
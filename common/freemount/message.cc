@@ -0,0 +1,56 @@
+/*
+	freemount/message.cc
+	--------------------
+*/
+
+#include "freemount/message.hh"
+
+// Standard C++
+#include <vector>
+
+// freemount
+#include "freemount/send_queue.hh"
+#include "freemount/write_in_full.hh"
+
+
+namespace freemount
+{
+	
+	const char message_padding[ 4 ] = { 0 };
+	
+	void send_message( int fd, iovec* iov, int n )
+	{
+		writev_in_full( fd, iov, n );
+	}
+	
+	void queue_message( send_queue& queue, const iovec* iov, int n )
+	{
+		size_t size = 0;
+		
+		for ( int i = 0;  i < n;  ++i )
+		{
+			size += iov[ i ].iov_len;
+		}
+		
+		if ( size > buffer::capacity() )
+		{
+			// Write what's pending, and then the message, whole.
+			
+			queue.write();
+			
+			std::vector< iovec > copy( iov, iov + n );
+			
+			writev_in_full( queue.fd(), &copy[ 0 ], n );
+			
+			return;
+		}
+		
+		queue.reserve( size );
+		
+		for ( int i = 0;  i < n;  ++i )
+		{
+			queue.add( iov[ i ].iov_base, iov[ i ].iov_len );
+		}
+	}
+	
+}
@@ -0,0 +1,371 @@
+/*
+	freemount/message.hh
+	--------------------
+*/
+
+#ifndef FREEMOUNT_MESSAGE_HH
+#define FREEMOUNT_MESSAGE_HH
+
+// POSIX
+#include <sys/uio.h>
+
+// Standard C
+#include <stdint.h>
+#include <string.h>
+
+// iota
+#include "iota/endian.hh"
+
+// freemount
+#include "freemount/frame.hh"
+#include "freemount/frame_size.hh"
+
+
+namespace freemount
+{
+	
+	class send_queue;
+	
+	/*
+		A message is a complete request -- a request frame, argument frames,
+		and a submit frame -- whose layout is fixed at compile time by its
+		argument types.  The frame headers (and integer arguments) are
+		encoded into an array sized for them at compile time, and strings
+		are referenced in place, so the whole message is written with one
+		writev() and no copying:
+		
+			typedef message< arg_path, arg_offset > read_message;
+			
+			read_message m( req_read, arg_path( path, size ),
+			                          arg_offset( offset ),
+			                          r_id );
+			
+			m.send( fd );
+		
+		Integers are still sent in their most compact form.  A message can
+		be sent (or queued) only once.
+		
+		Payloads are limited to max_plain_payload bytes, unless a larger
+		maximum was negotiated and is passed after the request id.  Encoding
+		a larger one throws payload_too_large.
+	*/
+	
+	class payload_too_large {};
+	
+	struct no_arg {};
+	
+	struct arg_path
+	{
+		const char*  data;
+		uint32_t     size;
+		
+		arg_path( const char* data, uint32_t size ) : data( data ), size( size )
+		{
+		}
+	};
+	
+	struct arg_data
+	{
+		const char*  data;
+		uint32_t     size;
+		
+		arg_data( const char* data, uint32_t size ) : data( data ), size( size )
+		{
+		}
+	};
+	
+	template < uint8_t frame_type, class Int >
+	struct arg_int
+	{
+		Int value;
+		
+		explicit arg_int( Int value ) : value( value )
+		{
+		}
+	};
+	
+	typedef arg_int< Frame_arg_features, uint32_t > arg_features;
+	typedef arg_int< Frame_arg_fd,       uint32_t > arg_fd;
+	typedef arg_int< Frame_io_count,     uint64_t > arg_count;
+	typedef arg_int< Frame_seek_offset,  uint64_t > arg_offset;
+	typedef arg_int< Frame_block_size,   uint32_t > arg_block_size;
+	
+	
+	extern const char message_padding[ 4 ];
+	
+	class message_encoder
+	{
+		private:
+			char*     its_mark;   // the next header byte
+			char*     its_run;    // the first header byte not yet in an iovec
+			iovec*    its_iovec;  // the next iovec
+			uint32_t  its_max_payload;
+		
+		public:
+			message_encoder( void*     headers,
+			                 iovec*    iovecs,
+			                 uint32_t  max_payload = max_plain_payload )
+			:
+				its_mark( (char*) headers ),
+				its_run ( (char*) headers ),
+				its_iovec( iovecs ),
+				its_max_payload( max_payload )
+			{
+			}
+			
+			void put_header( uint8_t   type,
+			                 uint8_t   data,
+			                 uint32_t  size,
+			                 uint16_t  r_id )
+			{
+				if ( size > its_max_payload )
+				{
+					throw payload_too_large();
+				}
+				
+				frame_header header = FREEMOUNT_FRAME_HEADER_INITIALIZER;
+				
+				header.type = type;
+				header.data = data;
+				
+				set_payload_size( header, size );
+				set_request_id  ( header, r_id );
+				
+				memcpy( its_mark, &header, sizeof header );
+				
+				its_mark += sizeof header;
+			}
+			
+			void put_bytes( const void* data, size_t n )
+			{
+				memcpy( its_mark, data, n );
+				
+				its_mark += n;
+			}
+			
+			void put_iovec( const void* data, size_t n )
+			{
+				its_iovec->iov_base = (void*) data;
+				its_iovec->iov_len  = n;
+				
+				++its_iovec;
+			}
+			
+			void put_payload_ref( const void* data, uint32_t n )
+			{
+				put_iovec( its_run, its_mark - its_run );
+				put_iovec( data, n );
+				put_iovec( message_padding, 3 - ((n + 3) & 0x3) );
+				
+				its_run = its_mark;
+			}
+			
+			iovec* finish()
+			{
+				put_iovec( its_run, its_mark - its_run );
+				
+				return its_iovec;
+			}
+	};
+	
+	
+	template < class Arg > struct frame_layout;
+	
+	template <>
+	struct frame_layout< no_arg >
+	{
+		static const size_t header_size = 0;
+		static const size_t n_iovecs    = 0;
+		
+		static void encode( message_encoder& e, const no_arg&, uint16_t r_id )
+		{
+		}
+	};
+	
+	template <>
+	struct frame_layout< arg_path >
+	{
+		static const size_t header_size = sizeof (frame_header);
+		static const size_t n_iovecs    = 3;  // path, padding, next headers
+		
+		static void encode( message_encoder& e, const arg_path& arg, uint16_t r_id )
+		{
+			e.put_header( Frame_arg_path, 0, arg.size, r_id );
+			
+			e.put_payload_ref( arg.data, arg.size );
+		}
+	};
+	
+	template <>
+	struct frame_layout< arg_data >
+	{
+		static const size_t header_size = sizeof (frame_header);
+		static const size_t n_iovecs    = 3;  // data, padding, next headers
+		
+		static void encode( message_encoder& e, const arg_data& arg, uint16_t r_id )
+		{
+			e.put_header( Frame_send_data, 0, arg.size, r_id );
+			
+			e.put_payload_ref( arg.data, arg.size );
+		}
+	};
+	
+	template < uint8_t frame_type >
+	struct frame_layout< arg_int< frame_type, uint32_t > >
+	{
+		static const size_t header_size = sizeof (frame_header) + 4;
+		static const size_t n_iovecs    = 0;
+		
+		static void encode( message_encoder&                          e,
+		                    const arg_int< frame_type, uint32_t >&  arg,
+		                    uint16_t                                  r_id )
+		{
+			const uint32_t value = arg.value;
+			
+			if ( value <= 0xFF )
+			{
+				e.put_header( frame_type, value, 0, r_id );
+				
+				return;
+			}
+			
+			const uint32_t big_value = iota::big_u32( value );
+			
+			e.put_header( frame_type, 0, sizeof value, r_id );
+			e.put_bytes( &big_value, sizeof value );
+		}
+	};
+	
+	template < uint8_t frame_type >
+	struct frame_layout< arg_int< frame_type, uint64_t > >
+	{
+		static const size_t header_size = sizeof (frame_header) + 8;
+		static const size_t n_iovecs    = 0;
+		
+		static void encode( message_encoder&                          e,
+		                    const arg_int< frame_type, uint64_t >&  arg,
+		                    uint16_t                                  r_id )
+		{
+			const uint64_t value = arg.value;
+			
+			if ( value <= 0xFFFFFFFFull )
+			{
+				const arg_int< frame_type, uint32_t > arg32( value );
+				
+				frame_layout< arg_int< frame_type, uint32_t > >::encode( e, arg32, r_id );
+				
+				return;
+			}
+			
+			const uint64_t big_value = iota::big_u64( value );
+			
+			e.put_header( frame_type, 0, sizeof value, r_id );
+			e.put_bytes( &big_value, sizeof value );
+		}
+	};
+	
+	
+	void send_message( int fd, iovec* iov, int n );
+	
+	void queue_message( send_queue& queue, const iovec* iov, int n );
+	
+	template < class A = no_arg, class B = no_arg, class C = no_arg >
+	class message
+	{
+		private:
+			typedef frame_layout< A > layout_A;
+			typedef frame_layout< B > layout_B;
+			typedef frame_layout< C > layout_C;
+			
+			static const size_t header_size = 2 * sizeof (frame_header)
+			                                + layout_A::header_size
+			                                + layout_B::header_size
+			                                + layout_C::header_size;
+			
+			static const size_t n_iovecs = 1
+			                             + layout_A::n_iovecs
+			                             + layout_B::n_iovecs
+			                             + layout_C::n_iovecs;
+			
+			uint32_t  its_headers[ header_size / sizeof (uint32_t) ];
+			iovec     its_iovecs [ n_iovecs ];
+			int       its_iovec_count;
+			
+			void encode( uint8_t   r_type,
+			             const A&  a,
+			             const B&  b,
+			             const C&  c,
+			             uint16_t  r_id,
+			             uint32_t  max_payload )
+			{
+				message_encoder e( its_headers, its_iovecs, max_payload );
+				
+				e.put_header( Frame_request, r_type, 0, r_id );
+				
+				layout_A::encode( e, a, r_id );
+				layout_B::encode( e, b, r_id );
+				layout_C::encode( e, c, r_id );
+				
+				e.put_header( Frame_submit, 0, 0, r_id );
+				
+				its_iovec_count = e.finish() - its_iovecs;
+			}
+			
+			// non-copyable
+			message           ( const message& );
+			message& operator=( const message& );
+		
+		public:
+			message( uint8_t   r_type,
+			         uint16_t  r_id,
+			         uint32_t  max_payload = max_plain_payload )
+			{
+				encode( r_type, A(), B(), C(), r_id, max_payload );
+			}
+			
+			message( uint8_t   r_type,
+			         const A&  a,
+			         uint16_t  r_id,
+			         uint32_t  max_payload = max_plain_payload )
+			{
+				encode( r_type, a, B(), C(), r_id, max_payload );
+			}
+			
+			message( uint8_t   r_type,
+			         const A&  a,
+			         const B&  b,
+			         uint16_t  r_id,
+			         uint32_t  max_payload = max_plain_payload )
+			{
+				encode( r_type, a, b, C(), r_id, max_payload );
+			}
+			
+			message( uint8_t   r_type,
+			         const A&  a,
+			         const B&  b,
+			         const C&  c,
+			         uint16_t  r_id,
+			         uint32_t  max_payload = max_plain_payload )
+			{
+				encode( r_type, a, b, c, r_id, max_payload );
+			}
+			
+			// For other means of sending, e.g. send_with_fd() in pass_fd.hh
+			
+			iovec* iovecs()             { return its_iovecs;      }
+			int    iovec_count() const  { return its_iovec_count; }
+			
+			void send( int fd )
+			{
+				send_message( fd, its_iovecs, its_iovec_count );
+			}
+			
+			void queue( send_queue& queue ) const
+			{
+				queue_message( queue, its_iovecs, its_iovec_count );
+			}
+	};
+	
+}
+
+#endif
@@ -0,0 +1,133 @@
+/*
+	freemount/pass_fd.cc
+	--------------------
+*/
+
+#include "freemount/pass_fd.hh"
+
+// POSIX
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// Standard C
+#include <errno.h>
+#include <string.h>
+
+// freemount
+#include "freemount/write_in_full.hh"
+
+
+namespace freemount
+{
+	
+	union fd_control
+	{
+		cmsghdr  header;
+		char     bytes[ CMSG_SPACE( sizeof (int) ) ];
+	};
+	
+	bool is_unix_socket( int fd )
+	{
+		sockaddr_un addr;
+		
+		socklen_t len = sizeof addr;
+		
+		if ( getsockname( fd, (sockaddr*) &addr, &len ) < 0 )
+		{
+			return false;
+		}
+		
+		return addr.sun_family == AF_UNIX;
+	}
+	
+	void send_message_with_fd( int sock, iovec* iov, int n, int passed_fd )
+	{
+		fd_control control;
+		
+		msghdr message;
+		
+		memset( &message, 0, sizeof message );
+		
+		message.msg_iov        = iov;
+		message.msg_iovlen     = n;
+		message.msg_control    = control.bytes;
+		message.msg_controllen = sizeof control.bytes;
+		
+		cmsghdr* cmsg = CMSG_FIRSTHDR( &message );
+		
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type  = SCM_RIGHTS;
+		cmsg->cmsg_len   = CMSG_LEN( sizeof (int) );
+		
+		memcpy( CMSG_DATA( cmsg ), &passed_fd, sizeof (int) );
+		
+		ssize_t n_sent;
+		
+		while ( (n_sent = sendmsg( sock, &message, 0 )) < 0 )
+		{
+			if ( errno != EINTR )
+			{
+				failed_write failure = { errno };
+				
+				throw failure;
+			}
+		}
+		
+		// The descriptor went with the first byte.  Send the rest normally.
+		
+		while ( n > 0  &&  size_t( n_sent ) >= iov->iov_len )
+		{
+			n_sent -= iov->iov_len;
+			
+			++iov;
+			--n;
+		}
+		
+		if ( n > 0 )
+		{
+			iov->iov_base = (char*) iov->iov_base + n_sent;
+			iov->iov_len -= n_sent;
+			
+			writev_in_full( sock, iov, n );
+		}
+	}
+	
+	ssize_t recv_with_fd( int sock, void* buffer, size_t n, int& passed_fd )
+	{
+		passed_fd = -1;
+		
+		iovec iov = { buffer, n };
+		
+		fd_control control;
+		
+		msghdr message;
+		
+		memset( &message, 0, sizeof message );
+		
+		message.msg_iov        = &iov;
+		message.msg_iovlen     = 1;
+		message.msg_control    = control.bytes;
+		message.msg_controllen = sizeof control.bytes;
+		
+		const ssize_t n_read = recvmsg( sock, &message, 0 );
+		
+		if ( n_read < 0 )
+		{
+			return n_read;
+		}
+		
+		for ( cmsghdr* cmsg = CMSG_FIRSTHDR( &message );
+		      cmsg != NULL;
+		      cmsg = CMSG_NXTHDR( &message, cmsg ) )
+		{
+			if ( cmsg->cmsg_level == SOL_SOCKET  &&  cmsg->cmsg_type == SCM_RIGHTS )
+			{
+				memcpy( &passed_fd, CMSG_DATA( cmsg ), sizeof (int) );
+			}
+		}
+		
+		return n_read;
+	}
+	
+}
@@ -0,0 +1,49 @@
+/*
+	freemount/pass_fd.hh
+	--------------------
+*/
+
+#ifndef FREEMOUNT_PASSFD_HH
+#define FREEMOUNT_PASSFD_HH
+
+// POSIX
+#include <sys/types.h>
+#include <sys/uio.h>
+
+
+namespace freemount
+{
+	
+	/*
+		Over a local (AF_UNIX) socket, a file descriptor can accompany a
+		message, e.g. so a client can share a mapped file with the server
+		instead of copying its contents.  The descriptor is attached to the
+		message's first byte, and arrives with whichever recv_with_fd()
+		call reads that byte.
+	*/
+	
+	bool is_unix_socket( int fd );
+	
+	// Like send_message(), and likewise throws failed_write
+	
+	void send_message_with_fd( int sock, iovec* iov, int n, int passed_fd );
+	
+	// Sends a message (see message.hh) along with passed_fd
+	
+	template < class Message >
+	inline
+	void send_with_fd( int sock, Message& m, int passed_fd )
+	{
+		send_message_with_fd( sock, m.iovecs(), m.iovec_count(), passed_fd );
+	}
+	
+	/*
+		Like read(), but also returns any file descriptor received in
+		passed_fd, or -1 if none was.
+	*/
+	
+	ssize_t recv_with_fd( int sock, void* buffer, size_t n, int& passed_fd );
+	
+}
+
+#endif
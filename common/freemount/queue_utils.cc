@@ -10,24 +10,28 @@
 
 // freemount
 #include "freemount/frame.hh"
+#include "freemount/frame_size.hh"
 #include "freemount/send_queue.hh"
 
 
 namespace freemount
 {
 	
-	void queue_int_( send_queue& queue, uint8_t type, uint8_t value, uint8_t r_id )
+	void queue_int_( send_queue& queue, uint8_t type, uint8_t value, uint16_t r_id )
 	{
 		frame_header header = FREEMOUNT_FRAME_HEADER_INITIALIZER;
 		
-		header.r_id = r_id;
 		header.type = type;
 		header.data = value;
 		
+		set_request_id( header, r_id );
+		
+		queue.reserve( sizeof header );
+		
 		queue.add( &header, sizeof header );
 	}
 	
-	void queue_int_( send_queue& queue, uint8_t type, uint32_t value, uint8_t r_id )
+	void queue_int_( send_queue& queue, uint8_t type, uint32_t value, uint16_t r_id )
 	{
 		if ( value <= 0xFF )
 		{
@@ -39,16 +43,19 @@ namespace freemount
 		frame_header header = FREEMOUNT_FRAME_HEADER_INITIALIZER;
 		
 		header.big_size = iota::big_u16( sizeof value );
-		header.r_id     = r_id;
 		header.type     = type;
 		
+		set_request_id( header, r_id );
+		
 		value = iota::big_u32( value );
 		
+		queue.reserve( sizeof header + sizeof value );
+		
 		queue.add( &header, sizeof header );
 		queue.add( &value,  sizeof value  );
 	}
 	
-	void queue_int_( send_queue& queue, uint8_t type, uint64_t value, uint8_t r_id )
+	void queue_int_( send_queue& queue, uint8_t type, uint64_t value, uint16_t r_id )
 	{
 		if ( value <= 0xFFFFFFFFull )
 		{
@@ -60,41 +67,99 @@ namespace freemount
 		frame_header header = FREEMOUNT_FRAME_HEADER_INITIALIZER;
 		
 		header.big_size = iota::big_u16( sizeof value );
-		header.r_id     = r_id;
 		header.type     = type;
 		
+		set_request_id( header, r_id );
+		
 		value = iota::big_u64( value );
 		
+		queue.reserve( sizeof header + sizeof value );
+		
 		queue.add( &header, sizeof header );
 		queue.add( &value,  sizeof value  );
 	}
 	
-	void queue_string( send_queue& queue, uint8_t type, const char* s, uint32_t len, uint8_t r_id )
+	static
+	void queue_payload( send_queue&  queue,
+	                    uint8_t      type,
+	                    const char*  s,
+	                    uint32_t     len,
+	                    uint16_t     r_id,
+	                    bool         by_ref )
 	{
 		frame_header header = FREEMOUNT_FRAME_HEADER_INITIALIZER;
 		
-		header.big_size = iota::big_u16( len );
-		header.r_id     = r_id;
-		header.type     = type;
+		header.type = type;
 		
-		queue.add( &header, sizeof header );
+		set_payload_size( header, len );
+		set_request_id  ( header, r_id );
+		
+		const int pad_length = 3 - ((len + 3) & 0x3);
 		
-		queue.add( s, len );
+		const size_t n_copied = sizeof header + pad_length;
 		
-		const int pad_length = 3 - (len + 3 & 0x3);
+		/*
+			A copied payload too large for the queue's buffer is referenced
+			instead, and the frame is written before we return.
+		*/
+		
+		const bool too_large = ! by_ref  &&  n_copied + len > buffer::capacity();
+		
+		if ( by_ref  ||  too_large )
+		{
+			queue.reserve( n_copied, 1 );
+		}
+		else
+		{
+			queue.reserve( n_copied + len );
+		}
+		
+		queue.add( &header, sizeof header );
+		
+		if ( by_ref  ||  too_large )
+		{
+			queue.add_ref( s, len );
+		}
+		else
+		{
+			queue.add( s, len );
+		}
 		
 		const uint32_t zero = 0;
 		
 		queue.add( &zero, pad_length );
+		
+		if ( too_large )
+		{
+			queue.write();
+		}
 	}
 	
-	void queue_buffer( send_queue& queue, uint8_t type, const char* s, uint32_t len, uint8_t r_id )
+	void queue_string( send_queue& queue, uint8_t type, const char* s, uint32_t len, uint16_t r_id )
 	{
-		enum
-		{
-			block_size = 0x4000,  // 16384
-			max_length = 0xFFFF,  // 65535
-		};
+		queue_payload( queue, type, s, len, r_id, false );
+	}
+	
+	void queue_data( send_queue& queue, uint8_t type, const char* s, uint32_t len, uint16_t r_id )
+	{
+		queue_payload( queue, type, s, len, r_id, true );
+	}
+	
+	void queue_buffer( send_queue&  queue,
+	                   uint8_t      type,
+	                   const char*  s,
+	                   uint32_t     len,
+	                   uint16_t     r_id,
+	                   uint32_t     max_length )
+	{
+		/*
+			With jumbo frames, each block is as large as the peer allows,
+			rounded down to a multiple of four, since the blocks are sent
+			without padding.
+		*/
+		
+		const uint32_t block_size = max_length > max_plain_payload ? max_length & ~3
+		                                                           : 0x4000;
 		
 		if ( len > max_length )
 		{
@@ -111,16 +176,18 @@ namespace freemount
 			
 			frame_header header = FREEMOUNT_FRAME_HEADER_INITIALIZER;
 			
-			header.big_size = iota::big_u16( block_size );
-			
-			header.r_id = r_id;
 			header.type = type;
 			
+			set_payload_size( header, block_size );
+			set_request_id  ( header, r_id );
+			
 			do
 			{
+				queue.reserve( sizeof header, 1 );
+				
 				queue.add( &header, sizeof header );
 				
-				queue.add( s, block_size );
+				queue.add_ref( s, block_size );
 				
 				s   += block_size;
 				len -= block_size;
@@ -130,7 +197,7 @@ namespace freemount
 		
 		if ( len )
 		{
-			queue_string( queue, type, s, len, r_id );
+			queue_data( queue, type, s, len, r_id );
 		}
 	}
 	
@@ -9,21 +9,40 @@
 // Standard C
 #include <stdint.h>
 
+// freemount
+#include "freemount/frame_size.hh"
+
 
 namespace freemount
 {
 	
 	class send_queue;
 	
-	void queue_int_( send_queue& queue, uint8_t type, uint8_t  value, uint8_t r_id = 0 );
-	void queue_int_( send_queue& queue, uint8_t type, uint32_t value, uint8_t r_id = 0 );
-	void queue_int_( send_queue& queue, uint8_t type, uint64_t value, uint8_t r_id = 0 );
+	void queue_int_( send_queue& queue, uint8_t type, uint8_t  value, uint16_t r_id = 0 );
+	void queue_int_( send_queue& queue, uint8_t type, uint32_t value, uint16_t r_id = 0 );
+	void queue_int_( send_queue& queue, uint8_t type, uint64_t value, uint16_t r_id = 0 );
+	
+	void queue_string( send_queue& queue, uint8_t type, const char* s, uint32_t len, uint16_t r_id = 0 );
+	
+	/*
+		queue_data() and queue_buffer() reference the payload rather than
+		copying it, so it must remain valid until the queue is written.
+		
+		queue_buffer() splits payloads longer than max_length into several
+		frames.  Pass max_jumbo_payload only if jumbo frames are enabled.
+	*/
+	
+	void queue_data  ( send_queue& queue, uint8_t type, const char* s, uint32_t len, uint16_t r_id = 0 );
 	
-	void queue_string( send_queue& queue, uint8_t type, const char* s, uint32_t len, uint8_t r_id = 0 );
-	void queue_buffer( send_queue& queue, uint8_t type, const char* s, uint32_t len, uint8_t r_id = 0 );
+	void queue_buffer( send_queue&  queue,
+	                   uint8_t      type,
+	                   const char*  s,
+	                   uint32_t     len,
+	                   uint16_t     r_id       = 0,
+	                   uint32_t     max_length = max_plain_payload );
 	
 	inline
-	void queue_empty( send_queue& queue, uint8_t type, uint8_t r_id = 0 )
+	void queue_empty( send_queue& queue, uint8_t type, uint16_t r_id = 0 )
 	{
 		queue_int_( queue, type, uint8_t(), r_id );
 	}
@@ -34,7 +53,7 @@ namespace freemount
 	
 	template < class Int >
 	inline
-	void queue_int( send_queue& queue, uint8_t type, Int value, uint8_t r_id = 0 )
+	void queue_int( send_queue& queue, uint8_t type, Int value, uint16_t r_id = 0 )
 	{
 		typedef typename freemount_int< sizeof (Int) >::type int_t;
 		
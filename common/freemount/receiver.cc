@@ -5,9 +5,17 @@
 
 #include "freemount/receiver.hh"
 
+// Standard C
+#include <errno.h>
+#include <string.h>
+
 // iota
 #include "iota/endian.hh"
 
+// freemount
+#include "freemount/compress.hh"
+#include "freemount/frame_size.hh"
+
 
 namespace freemount
 {
@@ -15,19 +23,145 @@ namespace freemount
 	typedef plus::string::size_type size_t;
 	
 	
-	data_receiver::data_receiver( frame_handler_function handler, void* context )
+	int dispatch_frames( frame_handler_function  handler,
+	                     void*                   context,
+	                     const frame_header*     begin,
+	                     const frame_header*&    end )
+	{
+		for ( const frame_header* it = begin;  it != end;  it = next_frame( *it ) )
+		{
+			if ( const int status = handler( context, *it ) )
+			{
+				end = next_frame( *it );
+				
+				return status;
+			}
+		}
+		
+		return 0;
+	}
+	
+	static inline
+	bool is_compressed( const frame_header& h )
+	{
+		return h.type == Frame_recv_zdata  ||  h.type == Frame_send_zdata;
+	}
+	
+	static
+	bool any_compressed( const frame_header* begin, const frame_header* end )
+	{
+		for ( const frame_header* it = begin;  it != end;  it = next_frame( *it ) )
+		{
+			if ( is_compressed( *it ) )
+			{
+				return true;
+			}
+		}
+		
+		return false;
+	}
+	
+	static
+	const frame_header* skip_frames( const frame_header* it, unsigned n )
+	{
+		while ( n-- > 0 )
+		{
+			it = next_frame( *it );
+		}
+		
+		return it;
+	}
+	
+	static
+	unsigned count_frames( const frame_header* begin, const frame_header* end )
+	{
+		unsigned n = 0;
+		
+		for ( const frame_header* it = begin;  it != end;  it = next_frame( *it ) )
+		{
+			++n;
+		}
+		
+		return n;
+	}
+	
+	/*
+		Append frame h to out, decompressing it if necessary.  Return false
+		if it's malformed.
+	*/
+	
+	static
+	bool append_decoded( std::vector< char >& out, const frame_header& h )
+	{
+		const char* frame = (const char*) &h;
+		
+		if ( ! is_compressed( h ) )
+		{
+			out.insert( out.end(), frame, frame + get_frame_size( h ) );
+			
+			return true;
+		}
+		
+		const char*    packed      = (const char*) get_payload_data( h );
+		const uint32_t packed_size = get_payload_size( h );
+		
+		uint32_t size;
+		
+		if ( packed_size < sizeof size )
+		{
+			return false;
+		}
+		
+		memcpy( &size, packed, sizeof size );
+		
+		size = iota::u32_from_big( size );
+		
+		if ( size == 0  ||  size > max_jumbo_payload )
+		{
+			return false;
+		}
+		
+		const size_t mark = out.size();
+		
+		out.resize( mark + sizeof h + ((size + 3) & ~3) );  // zero-filled
+		
+		frame_header& decoded = *(frame_header*) &out[ mark ];
+		
+		decoded      = h;
+		decoded.type = plain_frame_type( h.type );
+		
+		set_payload_size( decoded, size );
+		
+		char* payload = (char*) get_payload_data( decoded );
+		
+		const long n = decompress_block( packed      + sizeof size,
+		                                 packed_size - sizeof size,
+		                                 payload,
+		                                 size );
+		
+		return n == long( size );
+	}
+	
+	data_receiver::data_receiver( frame_handler_function  handler,
+	                              void*                   context,
+	                              batch_end_function      batch_end )
 	:
 		its_handler( handler ),
+		its_batch_handler(),
+		its_batch_end( batch_end ),
 		its_context( context )
 	{
 	}
 	
-	static inline
-	size_t pad( size_t value, unsigned multiple )
+	data_receiver::data_receiver( frame_batch_function  handler,
+	                              void*                 context,
+	                              batch_end_function    batch_end )
+	:
+		its_handler(),
+		its_batch_handler( handler ),
+		its_batch_end( batch_end ),
+		its_context( context )
 	{
-		const unsigned mask = multiple - 1;
-		
-		return (value + mask) & ~mask;
 	}
 	
 	int data_receiver::recv_bytes( const char* buffer, size_t n )
@@ -39,37 +173,140 @@ namespace freemount
 		
 		const char* p = data;
 		
+		int oversized = 0;
+		
+		// Find the end of the last complete frame.
+		
 		while ( data_size >= sizeof (frame_header) )
 		{
 			const frame_header& h = *(const frame_header*) p;
 			
-			const size_t payload_size = iota::u16_from_big( h.big_size );
+			if ( get_payload_size( h ) > max_jumbo_payload )
+			{
+				// Don't buffer it.  Handle what came before, then fail.
+				
+				oversized = -EMSGSIZE;
+				break;
+			}
 			
-			const size_t frame_size = sizeof (frame_header)
-			                        + pad( payload_size, 4 );
+			const size_t frame_size = get_frame_size( h );
 			
 			if ( data_size < frame_size )
 			{
 				break;
 			}
 			
-			const int status = its_handler( its_context, h );
+			data_size -= frame_size;
+			p         += frame_size;
+		}
+		
+		if ( p == data )
+		{
+			return oversized;
+		}
+		
+		const frame_header* begin = (const frame_header*) data;
+		const frame_header* end   = (const frame_header*) p;
+		
+		int status = 0;
+		
+		if ( its_batch_handler )
+		{
+			if ( any_compressed( begin, end ) )
+			{
+				its_decoded.clear();
+				
+				for ( const frame_header* it = begin;  it != end;  it = next_frame( *it ) )
+				{
+					if ( ! append_decoded( its_decoded, *it ) )
+					{
+						status = -EBADMSG;
+						break;
+					}
+				}
+				
+				if ( status == 0 )
+				{
+					// Only now is its_decoded known not to be empty.
+					
+					const char* decoded = &its_decoded[ 0 ];
+					
+					begin = (const frame_header*) decoded;
+					end   = (const frame_header*) (decoded + its_decoded.size());
+				}
+			}
 			
-			if ( status != 0 )
+			if ( status == 0 )
 			{
-				return status;
+				const frame_header* stop = end;
+				
+				status = its_batch_handler( its_context, begin, stop );
+				
+				if ( status  &&  stop != end )
+				{
+					/*
+						As below, keep the frames the handler didn't get to.
+						If the batch was decoded, find them by position in
+						the received (still encoded) data.
+					*/
+					
+					const frame_header* raw = (const frame_header*) data;
+					
+					raw = skip_frames( raw, count_frames( begin, stop ) );
+					
+					data_size += p - (const char*) raw;
+					p          = (const char*) raw;
+				}
 			}
+		}
+		else
+		{
+			/*
+				Stop at the first frame whose handler returns nonzero, but
+				keep the frames after it, in case we're called again.
+			*/
 			
-			data_size -= frame_size;
-			p         += frame_size;
+			const frame_header* it = begin;
+			
+			while ( it != end )
+			{
+				const frame_header* h = it;
+				
+				it = next_frame( *h );
+				
+				if ( is_compressed( *h ) )
+				{
+					its_decoded.clear();
+					
+					h = append_decoded( its_decoded, *h )
+					  ? (const frame_header*) &its_decoded[ 0 ]
+					  : NULL;
+				}
+				
+				status = h ? its_handler( its_context, *h ) : -EBADMSG;
+				
+				if ( status )
+				{
+					data_size += (const char*) end - (const char*) it;
+					p          = (const char*) it;
+					break;
+				}
+			}
 		}
 		
-		if ( p != data )
+		if ( its_batch_end )
 		{
-			its_buffer.assign( p, data_size );
+			const int end_status = its_batch_end( its_context );
+			
+			if ( status == 0 )
+			{
+				status = end_status;
+			}
 		}
 		
-		return 0;
+		its_buffer.assign( p, data_size );
+		
+		return status ? status : oversized;
 	}
 	
 }
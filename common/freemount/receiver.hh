@@ -6,6 +6,9 @@
 #ifndef FREEMOUNT_RECEIVER_HH
 #define FREEMOUNT_RECEIVER_HH
 
+// Standard C++
+#include <vector>
+
 // plus
 #include "plus/var_string.hh"
 
@@ -18,18 +21,60 @@ namespace freemount
 	
 	typedef int (*frame_handler_function)( void*, const frame_header& );
 	
+	/*
+		A batch handler is passed all the complete frames received in one
+		call to recv_bytes(), as the contiguous range [begin, end).  Use
+		next_frame() (in frame_size.hh) to step through them.  A handler
+		that returns nonzero sets end to the frame after the last one it
+		handled; like the per-frame handler's, the frames it didn't get to
+		remain buffered for the next call.
+		
+		A batch-end hook is called after each batch of frames (whichever
+		kind of handler processed them), even if a handler returned nonzero.
+		
+		recv_bytes() returns -EMSGSIZE on encountering a frame whose payload
+		exceeds max_jumbo_payload, after handling the frames preceding it.
+		
+		Compressed data frames are decoded into plain ones before they're
+		passed to either kind of handler.  A malformed one yields -EBADMSG.
+	*/
+	
+	typedef int (*frame_batch_function)( void*, const frame_header*  begin,
+	                                            const frame_header*& end );
+	
+	typedef int (*batch_end_function)( void* );
+	
+	/*
+		Call handler for each frame in [begin, end).  On a nonzero status,
+		stop and set end to the next frame, as a batch handler must.
+	*/
+	
+	int dispatch_frames( frame_handler_function  handler,
+	                     void*                   context,
+	                     const frame_header*     begin,
+	                     const frame_header*&    end );
+	
 	class data_receiver
 	{
 		private:
 			typedef plus::string::size_type size_t;
 			
-			plus::var_string  its_buffer;
+			plus::var_string     its_buffer;
+			std::vector< char >  its_decoded;
 			
 			frame_handler_function  its_handler;
+			frame_batch_function    its_batch_handler;
+			batch_end_function      its_batch_end;
 			void*                   its_context;
 		
 		public:
-			data_receiver( frame_handler_function handler, void* context );
+			data_receiver( frame_handler_function  handler,
+			               void*                   context,
+			               batch_end_function      batch_end = 0 );
+			
+			data_receiver( frame_batch_function  handler,
+			               void*                 context,
+			               batch_end_function    batch_end = 0 );
 			
 			int recv_bytes( const char* buffer, size_t n );
 	};
@@ -23,4 +23,21 @@ namespace freemount
 		queue.flush();
 	}
 	
+	void read_ack_queue::flush()
+	{
+		if ( its_n_pending )
+		{
+			send_read_ack( its_fd, its_n_pending );
+			
+			its_n_pending = 0;
+		}
+	}
+	
+	int flush_read_acks( void* acks )
+	{
+		((read_ack_queue*) acks)->flush();
+		
+		return 0;
+	}
+	
 }
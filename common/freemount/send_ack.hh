@@ -12,6 +12,54 @@ namespace freemount
 	
 	void send_read_ack( int fd, unsigned n_bytes );
 	
+	/*
+		A read_ack_queue coalesces Frame_ack_read acknowledgements.  Acked
+		bytes accumulate until they reach the threshold, or until flush()
+		is called.  Call it at the end of each batch of received frames
+		(e.g. with a data_receiver batch-end hook), so acks are never held
+		while we wait for more data, which the server might be withholding
+		in turn.
+	*/
+	
+	class read_ack_queue
+	{
+		private:
+			int       its_fd;
+			unsigned  its_threshold;
+			unsigned  its_n_pending;
+			
+			// non-copyable
+			read_ack_queue           ( const read_ack_queue& );
+			read_ack_queue& operator=( const read_ack_queue& );
+		
+		public:
+			static const unsigned default_threshold = 64 * 1024;
+			
+			read_ack_queue( int fd, unsigned threshold = default_threshold )
+			:
+				its_fd( fd ),
+				its_threshold( threshold ),
+				its_n_pending()
+			{
+			}
+			
+			void acknowledge( unsigned n_bytes )
+			{
+				its_n_pending += n_bytes;
+				
+				if ( its_n_pending >= its_threshold )
+				{
+					flush();
+				}
+			}
+			
+			void flush();
+	};
+	
+	// A batch-end hook for receivers whose context is a read_ack_queue
+	
+	int flush_read_acks( void* acks );
+	
 }
 
 #endif
@@ -9,6 +9,8 @@
 #include "more/string.h"
 
 // freemount
+#include "freemount/io_ring.hh"
+#include "freemount/send_lock.hh"
 #include "freemount/write_in_full.hh"
 
 
@@ -23,28 +25,140 @@ namespace freemount
 		its_mark += n;
 	}
 	
-	void send_queue::flush()
+	void send_queue::write_pending()
 	{
-		write_in_full( its_fd, its_buffer.data(), its_buffer.size() );
+		const int n = its_iovec_count;
+		
+		its_iovec_count = 0;
 		
 		its_buffer.clear();
+		
+		if ( its_ring )
+		{
+			its_ring->writev_in_full( its_fd, its_iovecs, n );
+		}
+		else
+		{
+			writev_in_full( its_fd, its_iovecs, n );
+		}
 	}
 	
-	void send_queue::add( const void* data, size_t n )
+	void send_queue::uncork()
 	{
-		if ( n > its_buffer.freespace() )
+		if ( --its_cork_count == 0 )
 		{
 			flush();
+		}
+	}
+	
+	void send_queue::flush()
+	{
+		if ( its_cork_count == 0  &&  its_iovec_count != 0 )
+		{
+			write_pending();
+		}
+	}
+	
+	void send_queue::reserve( size_t n_bytes, int n_refs )
+	{
+		/*
+			Each reference takes an iovec, and so may the copied data on
+			either side of it.
+		*/
+		
+		const int n_iovecs = 1 + 2 * n_refs;
+		
+		if ( n_bytes > its_buffer.freespace()  ||  its_iovec_count + n_iovecs > max_iovecs )
+		{
+			write();
+		}
+	}
+	
+	void send_queue::add_ref( const void* data, size_t n )
+	{
+		if ( n == 0 )
+		{
+			return;
+		}
+		
+		if ( its_iovec_count == max_iovecs )
+		{
+			write_pending();
+		}
+		
+		iovec& v = its_iovecs[ its_iovec_count++ ];
+		
+		v.iov_base = (void*) data;
+		v.iov_len  = n;
+	}
+	
+	void send_queue::add( const void* data, size_t n )
+	{
+		if ( n == 0 )
+		{
+			return;
+		}
+		
+		if ( n > its_buffer.capacity() )
+		{
+			add_ref( data, n );
+			
+			write_pending();
+			
+			return;
+		}
+		
+		const char* mark = its_buffer.data() + its_buffer.size();
+		
+		iovec* last = its_iovec_count ? &its_iovecs[ its_iovec_count - 1 ]
+		                              : NULL;
+		
+		if ( last  &&  (const char*) last->iov_base + last->iov_len != mark )
+		{
+			last = NULL;  // the last iovec is a reference, not our buffer
+		}
+		
+		if ( n > its_buffer.freespace()  ||  (! last  &&  its_iovec_count == max_iovecs) )
+		{
+			write_pending();
 			
-			if ( n > its_buffer.capacity() )
-			{
-				write_in_full( its_fd, data, n );
-				
-				return;
-			}
+			mark = its_buffer.data();
+			last = NULL;
 		}
 		
 		its_buffer.append_UNCHECKED( data, n );
+		
+		if ( last )
+		{
+			last->iov_len += n;
+		}
+		else
+		{
+			iovec& v = its_iovecs[ its_iovec_count++ ];
+			
+			v.iov_base = (void*) mark;
+			v.iov_len  = n;
+		}
+	}
+	
+	send_cork::~send_cork()
+	{
+		/*
+			Release the cork under the send lock, so a corked queue's frames
+			can't interleave with another thread's.  A destructor can't throw
+			(and may be running during unwinding), so a failed write is left
+			for the session to discover when it next reads the connection.
+		*/
+		
+		send_lock lock;
+		
+		try
+		{
+			its_queue.uncork();
+		}
+		catch ( const failed_write& )
+		{
+		}
 	}
 	
 }
@@ -8,15 +8,18 @@
 
 // POSIX
 #include <sys/types.h>
+#include <sys/uio.h>
 
 
 namespace freemount
 {
 	
+	class io_ring;
+	
 	class buffer
 	{
 		private:
-			static const size_t buffer_length = 1024;
+			static const size_t buffer_length = 4096;
 			
 			char its_buffer[ buffer_length ];
 			
@@ -39,20 +42,96 @@ namespace freemount
 			void clear()  { its_mark = 0; }
 	};
 	
+	/*
+		A send_queue gathers frames and writes them with a single writev().
+		
+		add() copies its data into the queue's buffer (or, if the data won't
+		fit even in an empty buffer, writes it immediately along with any
+		pending data).  add_ref() merely references the caller's data, which
+		must remain valid until the queue is next written.
+		
+		flush() writes any pending data, unless the queue is corked, in which
+		case the write is deferred until the outermost uncork().  A full
+		buffer is written regardless of corking.  write() writes any pending
+		data now, corked or not.
+		
+		Writes must fall between frames, since other threads may write
+		their own frames to the same descriptor (under the send lock) once
+		the current lock scope ends.  So reserve() room for each frame
+		before adding it -- n_bytes to be copied, plus n_refs references --
+		and if the frame won't fit, the pending frames are written first.
+		The queue_*() functions in queue_utils do this.
+		
+		A queue given an io_ring with use_ring() writes through it, so each
+		write is submitted together with whatever else is prepared there.
+	*/
+	
 	class send_queue
 	{
+		friend class send_cork;
+		
 		private:
+			static const int max_iovecs = 16;
+			
 			buffer  its_buffer;
+			iovec   its_iovecs[ max_iovecs ];
+			int     its_iovec_count;
+			int     its_cork_count;
 			int     its_fd;
+			
+			io_ring*  its_ring;
+			
+			void write_pending();
+			
+			// non-copyable
+			send_queue           ( const send_queue& );
+			send_queue& operator=( const send_queue& );
 		
 		public:
-			send_queue( int fd ) : its_fd( fd )
+			send_queue( int fd )
+			:
+				its_iovec_count(),
+				its_cork_count(),
+				its_fd( fd ),
+				its_ring()
 			{
 			}
 			
+			int fd() const  { return its_fd; }
+			
+			void use_ring( io_ring* ring )  { its_ring = ring; }
+			
+			bool corked() const  { return its_cork_count != 0; }
+			
+			void cork()  { ++its_cork_count; }
+			void uncork();
+			
 			void flush();
 			
-			void add( const void* data, size_t n );
+			void write()  { if ( its_iovec_count ) write_pending(); }
+			
+			void reserve( size_t n_bytes, int n_refs = 0 );
+			
+			void add    ( const void* data, size_t n );
+			void add_ref( const void* data, size_t n );
+	};
+	
+	class send_cork
+	{
+		private:
+			send_queue& its_queue;
+			
+			// non-copyable
+			send_cork           ( const send_cork& );
+			send_cork& operator=( const send_cork& );
+		
+		public:
+			send_cork( send_queue& queue ) : its_queue( queue )
+			{
+				queue.cork();
+			}
+			
+			~send_cork();
 	};
 	
 }
@@ -9,6 +9,7 @@
 #include <errno.h>
 #include <unistd.h>
 #include <sys/select.h>
+#include <sys/uio.h>
 
 // Standard C
 #ifdef __APPLE__
@@ -23,6 +24,22 @@
 namespace freemount
 {
 	
+	static
+	void wait_until_writable( int fd )
+	{
+		fd_set write_fds;
+		
+		FD_ZERO( &write_fds );
+		
+		FD_SET( fd, &write_fds );
+		
+		int selected = select( fd + 1, NULL, &write_fds, NULL, NULL );
+		
+		(void) selected;
+		
+		// Only expected error is EINTR
+	}
+	
 	static
 	ssize_t write_all( int fd, const void* buffer, size_t n )
 	{
@@ -42,17 +59,56 @@ namespace freemount
 			}
 			else if ( errno == EAGAIN  ||  errno == EWOULDBLOCK )
 			{
-				fd_set write_fds;
-				
-				FD_ZERO( &write_fds );
-				
-				FD_SET( fd, &write_fds );
+				wait_until_writable( fd );
+				continue;
+			}
+			else if ( errno == EINTR )
+			{
+				continue;
+			}
+			else
+			{
+				return n_bytes != 0 ? ssize_t( n_bytes ) : -1;
+			}
+		}
+		
+		return n_bytes;
+	}
+	
+	static
+	ssize_t writev_all( int fd, iovec* iov, int n_iov )
+	{
+		size_t n_bytes = 0;
+		
+		while ( n_iov > 0 )
+		{
+			poseven::thread::testcancel();
+			
+			ssize_t n_written = writev( fd, iov, n_iov );
+			
+			if ( n_written >= 0 )
+			{
+				n_bytes += n_written;
 				
-				int selected = select( fd + 1, NULL, &write_fds, NULL, NULL );
+				// Skip the iovecs written in full, and trim a partial one.
 				
-				(void) selected;
+				while ( n_iov > 0  &&  size_t( n_written ) >= iov->iov_len )
+				{
+					n_written -= iov->iov_len;
+					
+					++iov;
+					--n_iov;
+				}
 				
-				// Only expected error is EINTR
+				if ( n_iov > 0 )
+				{
+					iov->iov_base = (char*) iov->iov_base + n_written;
+					iov->iov_len -= n_written;
+				}
+			}
+			else if ( errno == EAGAIN  ||  errno == EWOULDBLOCK )
+			{
+				wait_until_writable( fd );
 				continue;
 			}
 			else if ( errno == EINTR )
@@ -87,5 +143,46 @@ namespace freemount
 		}
 	}
 	
+	void pwrite_in_full( int fd, const void* buffer, size_t n, off_t offset )
+	{
+		while ( n > 0 )
+		{
+			const ssize_t n_written = pwrite( fd, buffer, n, offset );
+			
+			if ( n_written > 0 )
+			{
+				buffer = (char*) buffer + n_written;
+				
+				n      -= n_written;
+				offset += n_written;
+			}
+			else if ( n_written < 0  &&  errno == EINTR )
+			{
+				continue;
+			}
+			else
+			{
+				throw_failed_write( n_written < 0 ? errno : EIO );
+			}
+		}
+	}
+	
+	void writev_in_full( int fd, iovec* iov, int n )
+	{
+		size_t total = 0;
+		
+		for ( int i = 0;  i < n;  ++i )
+		{
+			total += iov[ i ].iov_len;
+		}
+		
+		const ssize_t n_written = writev_all( fd, iov, n );
+		
+		if ( size_t( n_written ) != total )
+		{
+			throw_failed_write( errno );
+		}
+	}
+	
 }
 
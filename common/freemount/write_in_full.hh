@@ -8,6 +8,7 @@
 
 // POSIX
 #include <sys/types.h>
+#include <sys/uio.h>
 
 
 namespace freemount
@@ -20,6 +21,17 @@ namespace freemount
 	
 	void write_in_full( int fd, const void* buffer, size_t n );
 	
+	// For regular files, which are always writable
+	
+	void pwrite_in_full( int fd, const void* buffer, size_t n, off_t offset );
+	
+	/*
+		writev_in_full() may modify the iovecs (as it advances past partial
+		writes), so callers shouldn't reuse them afterward.
+	*/
+	
+	void writev_in_full( int fd, iovec* iov, int n );
+	
 }
 
 #endif
@@ -0,0 +1,189 @@
+/*
+	freemount/xor_delta.cc
+	----------------------
+*/
+
+#include "freemount/xor_delta.hh"
+
+// Standard C
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+
+namespace freemount
+{
+	
+	/*
+		Compare and XOR a machine word at a time where we can.  (memcpy()
+		into a local is how to load an unaligned word portably; compilers
+		reduce it to a single load.)
+	*/
+	
+	typedef unsigned long word;
+	
+	static inline
+	word load( const char* p )
+	{
+		word w;
+		
+		memcpy( &w, p, sizeof w );
+		
+		return w;
+	}
+	
+	static
+	size_t equal_run( const char* a, const char* b, size_t n )
+	{
+		size_t i = 0;
+		
+		while ( n - i >= sizeof (word)  &&  load( a + i ) == load( b + i ) )
+		{
+			i += sizeof (word);
+		}
+		
+		while ( i < n  &&  a[ i ] == b[ i ] )
+		{
+			++i;
+		}
+		
+		return i;
+	}
+	
+	static
+	char* put_varint( char* p, size_t x )
+	{
+		while ( x >= 0x80 )
+		{
+			*p++ = char( x | 0x80 );
+			
+			x >>= 7;
+		}
+		
+		*p++ = char( x );
+		
+		return p;
+	}
+	
+	static
+	bool get_varint( const uint8_t*& p, const uint8_t* end, size_t& x )
+	{
+		x = 0;
+		
+		for ( unsigned shift = 0;  p < end  &&  shift < 35;  shift += 7 )
+		{
+			const uint8_t c = *p++;
+			
+			x |= size_t( c & 0x7F ) << shift;
+			
+			if ( ! (c & 0x80) )
+			{
+				return true;
+			}
+		}
+		
+		return false;
+	}
+	
+	static
+	void xor_into( char* out, const char* a, const char* b, size_t n )
+	{
+		size_t i = 0;
+		
+		for ( ;  n - i >= sizeof (word);  i += sizeof (word) )
+		{
+			const word w = load( a + i ) ^ load( b + i );
+			
+			memcpy( out + i, &w, sizeof w );
+		}
+		
+		for ( ;  i < n;  ++i )
+		{
+			out[ i ] = a[ i ] ^ b[ i ];
+		}
+	}
+	
+	size_t encode_xor_delta( const char* data,
+	                         const char* prior,
+	                         size_t      n,
+	                         char*       out )
+	{
+		char* p = out;
+		
+		size_t i = 0;
+		
+		while ( i < n )
+		{
+			const size_t skip = equal_run( data + i, prior + i, n - i );
+			
+			i += skip;
+			
+			if ( i == n )
+			{
+				break;  // The trailing unchanged bytes needn't be encoded.
+			}
+			
+			// Extend the changed run until a long enough unchanged one.
+			
+			size_t end = i + 1;
+			
+			while ( end < n )
+			{
+				const size_t same = equal_run( data + end, prior + end, n - end );
+				
+				if ( same >= min_xor_delta_skip  ||  end + same == n )
+				{
+					break;
+				}
+				
+				end += same + 1;
+			}
+			
+			const size_t length = end - i;
+			
+			p = put_varint( p, skip   );
+			p = put_varint( p, length );
+			
+			xor_into( p, data + i, prior + i, length );
+			
+			p += length;
+			i  = end;
+		}
+		
+		return p - out;
+	}
+	
+	int apply_xor_delta( const char* delta, size_t size, char* target, size_t n )
+	{
+		const uint8_t* p   = (const uint8_t*) delta;
+		const uint8_t* end = p + size;
+		
+		size_t i = 0;
+		
+		while ( p < end )
+		{
+			size_t skip;
+			size_t length;
+			
+			if ( ! get_varint( p, end, skip )  ||  ! get_varint( p, end, length ) )
+			{
+				return -EBADMSG;
+			}
+			
+			if ( skip > n - i  ||  length > n - i - skip  ||  length > size_t( end - p ) )
+			{
+				return -EBADMSG;
+			}
+			
+			i += skip;
+			
+			xor_into( target + i, target + i, (const char*) p, length );
+			
+			i += length;
+			p += length;
+		}
+		
+		return 0;
+	}
+	
+}
@@ -0,0 +1,59 @@
+/*
+	freemount/xor_delta.hh
+	----------------------
+*/
+
+#ifndef FREEMOUNT_XORDELTA_HH
+#define FREEMOUNT_XORDELTA_HH
+
+// Standard C
+#include <stddef.h>
+
+
+namespace freemount
+{
+	
+	/*
+		An XOR delta encodes the difference between two versions of a block
+		of bytes (typically raster rows):  The XOR of the two is mostly
+		zeros wherever the content is unchanged, and those runs compress to
+		almost nothing.
+		
+		The encoding is a series of records, each of which is a count of
+		unchanged bytes to skip, then a count of bytes to XOR into the
+		target, then those bytes.  Counts are LEB128 varints (seven bits per
+		byte, low-order first, with the high bit set in all but the last).
+		Runs of fewer than min_xor_delta_skip unchanged bytes are folded
+		into the surrounding XOR bytes, so the encoding of n bytes is never
+		longer than max_xor_delta_size( n ).
+	*/
+	
+	const size_t min_xor_delta_skip = 8;
+	
+	inline
+	size_t max_xor_delta_size( size_t n )
+	{
+		return n + 10;
+	}
+	
+	/*
+		Encode the changes from prior to data (n bytes each) into out, which
+		must have room for max_xor_delta_size( n ) bytes.  Returns the size
+		of the encoding, which is zero if nothing changed.
+	*/
+	
+	size_t encode_xor_delta( const char* data,
+	                         const char* prior,
+	                         size_t      n,
+	                         char*       out );
+	
+	/*
+		Apply an encoded delta to target (n bytes).  Returns zero, or
+		-EBADMSG if the encoding is malformed or overruns the target.
+	*/
+	
+	int apply_xor_delta( const char* delta, size_t size, char* target, size_t n );
+	
+}
+
+#endif
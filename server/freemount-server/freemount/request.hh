@@ -34,6 +34,9 @@ namespace freemount
 		
 		int fd;
 		
+		uint32_t features;  // vers: requested; tasks: the session's
+		uint32_t block_size;
+		
 		request_task* task;
 		
 		request( request_type type = req_none );
@@ -53,6 +56,8 @@ namespace freemount
 		n( -1 ),
 		offset( -1 ),
 		fd( -1 ),
+		features(),
+		block_size(),
 		task()
 	{
 	}
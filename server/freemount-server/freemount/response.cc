@@ -19,7 +19,7 @@
 namespace freemount {
 
 
-void send_response( send_queue& queue, int result, uint8_t r_id )
+void send_response( send_queue& queue, int result, uint16_t r_id )
 {
 	if ( result >= 0 )
 	{
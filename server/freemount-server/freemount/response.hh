@@ -15,7 +15,7 @@ namespace freemount
 	
 	class send_queue;
 	
-	void send_response( send_queue& queue, int result, uint8_t r_id );
+	void send_response( send_queue& queue, int result, uint16_t r_id );
 	
 }
 
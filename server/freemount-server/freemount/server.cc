@@ -10,11 +10,16 @@
 #include <unistd.h>
 #include <sys/stat.h>
 
+// Standard C++
+#include <vector>
+
 // Standard C
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 // plus
+#include "plus/var_string.hh"
 #include "plus/string/concat.hh"
 
 // poseven
@@ -40,14 +45,19 @@
 #include "vfs/primitives/stat.hh"
 
 // freemount
+#include "freemount/block_sums.hh"
+#include "freemount/compress.hh"
 #include "freemount/data_flow.hh"
 #include "freemount/frame_size.hh"
+#include "freemount/io_ring.hh"
 #include "freemount/queue_utils.hh"
 #include "freemount/request.hh"
 #include "freemount/response.hh"
 #include "freemount/send_lock.hh"
+#include "freemount/send_queue.hh"
 #include "freemount/session.hh"
 #include "freemount/task.hh"
+#include "freemount/watch.hh"
 
 
 #define ARRAY_LEN( a )  (sizeof a / sizeof a[0])
@@ -64,10 +74,91 @@ using ::write;
 
 
 bool writes_allowed = false;
+bool verbose        = false;
+
+
+/*
+	Each read() task moves file data in blocks of this size, which is also
+	the payload size of each Frame_recv_data it sends.  It must not exceed
+	the 16-bit frame size, unless the client has enabled jumbo frames, in
+	which case it must not exceed max_jumbo_payload.  Larger blocks mean
+	fewer pread() and write() calls per byte transferred.
+*/
+
+#ifdef __RELIX__
+
+const size_t read_block_size = 4096;
+
+#else
+
+const size_t read_block_size = 32768;
 
+#endif
+
+const size_t jumbo_read_block_size = 262144;  // 256 KiB
+
+
+/*
+	Wide request ids need little server state:  Once they're granted, every
+	id is read from (and echoed back in) both header bytes.  Until then, _6
+	is ignored, as it always was.  Jumbo frames and compressed frames are likewise
+	always accepted, but read() sends them only if they've been granted.
+	Batching is how frame_batch_handler() works; it's advertised so clients
+	know that pipelining requests will pay off.
+	Stat mtimes are sent only if granted, because older clients reject
+	stat frames they don't recognize.
+*/
+
+const uint32_t supported_features = Feature_wide_ids
+                                  | Feature_jumbo_frames
+                                  | Feature_compression
+                                  | Feature_batching
+                                  | Feature_stat_mtime;
 
 static
-int stat( session& s, uint8_t r_id, const request& r )
+int vers( session& s, uint16_t r_id, const request& r )
+{
+	const uint32_t granted = r.features & supported_features;
+	
+	s.set_features( granted );
+	
+	const uint32_t max_payload = granted & Feature_jumbo_frames ? max_jumbo_payload
+	                                                            : max_plain_payload;
+	
+	send_lock lock;
+	
+	queue_int( s.queue(), Frame_features,    granted,                 r_id );
+	queue_int( s.queue(), Frame_max_payload, max_payload,             r_id );
+	queue_int( s.queue(), Frame_window,      get_congestion_window(), r_id );
+	
+	return 0;
+}
+
+/*
+	Whole seconds aren't enough to tell a file rewritten within the same
+	second (at the same size) from the original, so send nanoseconds.
+*/
+
+static inline
+uint64_t mtime_ns( const struct stat& sb )
+{
+	uint64_t ns = uint64_t( sb.st_mtime ) * 1000000000;
+	
+#ifdef __APPLE__
+	
+	ns += sb.st_mtimespec.tv_nsec;
+	
+#elif defined( __linux__ )
+	
+	ns += sb.st_mtim.tv_nsec;
+	
+#endif
+	
+	return ns;
+}
+
+static
+int stat( session& s, uint16_t r_id, const request& r )
 {
 	struct stat sb;
 	
@@ -98,11 +189,16 @@ int stat( session& s, uint8_t r_id, const request& r )
 		queue_int( s.queue(), Frame_stat_size, sb.st_size, r_id );
 	}
 	
+	if ( s.features() & Feature_stat_mtime )
+	{
+		queue_int( s.queue(), Frame_stat_mtime, mtime_ns( sb ), r_id );
+	}
+	
 	return 0;
 }
 
 static
-int list( session& s, uint8_t r_id, const request& r )
+int list( session& s, uint16_t r_id, const request& r )
 {
 	vfs::dir_contents contents;
 	
@@ -132,7 +228,7 @@ int list( session& s, uint8_t r_id, const request& r )
 }
 
 static
-int open( session& s, uint8_t r_id, const request& r )
+int open( session& s, uint16_t r_id, const request& r )
 {
 	if ( ! writes_allowed )
 	{
@@ -163,7 +259,7 @@ int open( session& s, uint8_t r_id, const request& r )
 }
 
 static
-int close( session& s, uint8_t r_id, const request& r )
+int close( session& s, uint16_t r_id, const request& r )
 {
 	int fd = r.fd;
 	
@@ -178,7 +274,7 @@ int close( session& s, uint8_t r_id, const request& r )
 }
 
 static
-int read_slurp( session& s, uint8_t r_id, const vfs::node& that )
+int read_slurp( send_queue& queue, uint16_t r_id, const vfs::node& that )
 {
 	// No need to try/catch, because we're called from read()'s try block
 	
@@ -190,19 +286,169 @@ int read_slurp( session& s, uint8_t r_id, const vfs::node& that )
 	
 	send_lock lock;
 	
-	queue_int   ( s.queue(), Frame_stat_size,               size, r_id );
-	queue_string( s.queue(), Frame_recv_data, bytes.data(), size, r_id );
+	queue_int ( queue, Frame_stat_size,               size, r_id );
+	queue_data( queue, Frame_recv_data, bytes.data(), size, r_id );
 	
-	s.queue().flush();
+	queue.flush();
 	
 	return 0;
 }
 
 static
-int read( session& s, uint8_t r_id, const request& r )
+void report_compression( uint16_t r_id, const compression_stats& stats )
+{
+	if ( ! verbose )
+	{
+		return;
+	}
+	
+	fprintf( stderr, "Request id %u: compressed %llu bytes to %llu"
+	                 " (%u frames packed, %u skipped) in %llu us\n",
+	                 r_id,
+	                 (unsigned long long) stats.n_bytes_in,
+	                 (unsigned long long) stats.n_bytes_out,
+	                 stats.n_frames_packed,
+	                 stats.n_frames_skipped,
+	                 (unsigned long long) stats.cpu_usecs );
+}
+
+/*
+	Where io_uring works, read() sends each block of a plain file in the
+	same system call that reads the next one.  That needs the file's native
+	descriptor, which vfs filehandles don't expose, so we open the file by
+	its native path -- only if the path can't leave the native root, and
+	only if the result is the very file the vfs resolved.
+*/
+
+static
+int open_native( const plus::string& path, const struct stat& sb )
+{
+	if ( native_root == NULL  ||  path[ 0 ] != '/'  ||  strstr( path.c_str(), "/.." ) )
+	{
+		return -1;
+	}
+	
+	plus::var_string native_path = native_root;
+	
+	native_path += path;
+	
+	int fd = ::open( native_path.c_str(), O_RDONLY | O_NOCTTY );
+	
+	struct stat st;
+	
+	if ( fd >= 0  &&  (fstat( fd, &st ) < 0  ||  st.st_dev != sb.st_dev
+	                                         ||  st.st_ino != sb.st_ino) )
+	{
+		::close( fd );
+		
+		fd = -1;
+	}
+	
+	return fd;
+}
+
+static inline
+size_t read_count( int64_t n_requested, size_t block_size )
+{
+	return n_requested >= 0  &&  uint64_t( n_requested ) < block_size ? n_requested
+	                                                               : block_size;
+}
+
+static
+int read_with_ring( send_queue&       queue,
+                    io_ring&          ring,
+                    int               fd,
+                    uint16_t          r_id,
+                    int64_t           n_requested,
+                    off_t             offset,
+                    size_t            block_size,
+                    data_compressor*  compressor )
 {
+	/*
+		Alternate between two blocks:  While one is being sent, the next
+		is read into the other.
+	*/
+	
+	std::vector< char > blocks( block_size * 2 );
+	
+	char* buffers[] = { &blocks[ 0 ], &blocks[ block_size ] };
+	
+	const unsigned tag = 0;
+	
+	size_t n = read_count( n_requested, block_size );
+	
+	if ( n != 0 )
+	{
+		ring.prep_pread( fd, buffers[ 0 ], n, offset, tag );
+		ring.run();
+	}
+	
+	ssize_t n_read = n ? ring.result( tag ) : 0;
+	
+	queue.use_ring( &ring );
+	
+	for ( int i = 0;  n_read > 0;  i = 1 - i )
+	{
+		const char* buffer = buffers[ i ];
+		
+		offset += n_read;
+		
+		if ( n_requested > 0 )
+		{
+			n_requested -= n_read;
+		}
+		
+		n = read_count( n_requested, block_size );
+		
+		if ( n != 0 )
+		{
+			ring.prep_pread( fd, buffers[ 1 - i ], n, offset, tag );
+		}
+		
+		data_transmitting( n_read );
+		
+		{
+			send_lock lock;
+			
+			if ( compressor )
+			{
+				compressor->queue( queue, Frame_recv_data, buffer, n_read, r_id );
+			}
+			else
+			{
+				queue_data( queue, Frame_recv_data, buffer, n_read, r_id );
+			}
+			
+			queue.flush();  // submits the next read along with the write
+		}
+		
+		if ( ring.n_prepared() )
+		{
+			ring.run();
+		}
+		
+		n_read = n ? ring.result( tag ) : 0;
+	}
+	
+	queue.use_ring( NULL );
+	
+	return n_read < 0 ? n_read : 0;
+}
+
+static
+int read( session& s, uint16_t r_id, const request& r )
+{
+	/*
+		We run in our own thread, so use our own queue rather than the
+		session's, which belongs to the frame handler's thread.
+	*/
+	
+	send_queue queue( s.send_fd );
+	
 	vfs::filehandle_ptr file;
 	
+	struct stat sb = { 0 };
+	
 	try
 	{
 		vfs::node_ptr that = vfs::resolve_pathname( s.root(), r.path, s.cwd() );
@@ -215,7 +461,7 @@ int read( session& s, uint8_t r_id, const request& r )
 		{
 			if ( err == ENOENT )
 			{
-				return read_slurp( s, r_id, *that );
+				return read_slurp( queue, r_id, *that );
 			}
 			
 			return -err;
@@ -223,11 +469,13 @@ int read( session& s, uint8_t r_id, const request& r )
 		
 		if ( S_ISREG( that->filemode() ) )
 		{
+			stat( *that, sb );
+			
 			const uint64_t size = geteof( *file );
 			
 			send_lock lock;
 			
-			queue_int( s.queue(), Frame_stat_size, size, r_id );
+			queue_int( queue, Frame_stat_size, size, r_id );
 		}
 	}
 	catch ( const p7::errno_t& err )
@@ -239,11 +487,48 @@ int read( session& s, uint8_t r_id, const request& r )
 	
 	off_t offset = r.offset;
 	
-	while ( true )
+	const bool jumbo    = r.features & Feature_jumbo_frames;
+	const bool compress = r.features & Feature_compression;
+	
+	data_compressor compressor;
+	
+	const size_t block_size = jumbo ? jumbo_read_block_size : read_block_size;
+	
+	if ( S_ISREG( sb.st_mode )  &&  offset >= 0 )
 	{
-		char buffer[ 4096 ];
+		io_ring ring;
 		
-		size_t n = sizeof buffer;
+		const int fd = ring.usable() ? open_native( r.path, sb ) : -1;
+		
+		if ( fd >= 0 )
+		{
+			const int result = read_with_ring( queue,
+			                                   ring,
+			                                   fd,
+			                                   r_id,
+			                                   n_requested,
+			                                   offset,
+			                                   block_size,
+			                                   compress ? &compressor : NULL );
+			
+			::close( fd );
+			
+			if ( compress )
+			{
+				report_compression( r_id, compressor.stats() );
+			}
+			
+			return result;
+		}
+	}
+	
+	std::vector< char > block( block_size );
+	
+	char* buffer = &block[ 0 ];
+	
+	while ( true )
+	{
+		size_t n = block.size();
 		
 		if ( n_requested == 0 )
 		{
@@ -288,16 +573,125 @@ int read( session& s, uint8_t r_id, const request& r )
 		
 		send_lock lock;
 		
-		queue_string( s.queue(), Frame_recv_data, buffer, n_read, r_id );
+		if ( compress )
+		{
+			compressor.queue( queue, Frame_recv_data, buffer, n_read, r_id );
+		}
+		else
+		{
+			queue_data( queue, Frame_recv_data, buffer, n_read, r_id );
+		}
+		
+		queue.flush();
+	}
+	
+	if ( compress )
+	{
+		report_compression( r_id, compressor.stats() );
+	}
+	
+	return 0;
+}
+
+static
+size_t read_block( vfs::filehandle& file, char* buffer, size_t n )
+{
+	size_t n_read = 0;
+	
+	while ( n_read < n )
+	{
+		const ssize_t got = read( file, buffer + n_read, n - n_read );
 		
-		s.queue().flush();
+		if ( got == 0 )
+		{
+			break;
+		}
+		
+		n_read += got;
+	}
+	
+	return n_read;
+}
+
+static
+int sums( session& s, uint16_t r_id, const request& r )
+{
+	// Like read(), we run in our own thread and use our own queue.
+	
+	send_queue queue( s.send_fd );
+	
+	const uint32_t block_size = r.block_size ? r.block_size
+	                                         : default_sums_block_size;
+	
+	if ( block_size < min_sums_block_size  ||  block_size > max_sums_block_size )
+	{
+		return -EINVAL;
+	}
+	
+	const size_t sums_per_frame = 1024;
+	
+	char encoded[ sums_per_frame * encoded_block_sum_size ];
+	
+	size_t n_sums = 0;
+	
+	try
+	{
+		vfs::node_ptr that = vfs::resolve_pathname( s.root(), r.path, s.cwd() );
+		
+		vfs::filehandle_ptr file = open( *that, O_RDONLY, 0 );
+		
+		if ( S_ISREG( that->filemode() ) )
+		{
+			const uint64_t size = geteof( *file );
+			
+			send_lock lock;
+			
+			queue_int( queue, Frame_stat_size, size, r_id );
+		}
+		
+		std::vector< char > block( block_size );
+		
+		char* buffer = &block[ 0 ];
+		
+		size_t n;
+		
+		do
+		{
+			n = read_block( *file, buffer, block_size );
+			
+			if ( n != 0 )
+			{
+				const block_sum sum = get_block_sum( buffer, n );
+				
+				encode_block_sum( encoded + n_sums++ * encoded_block_sum_size, sum );
+			}
+			
+			if ( n_sums == sums_per_frame  ||  (n < block_size  &&  n_sums != 0) )
+			{
+				send_lock lock;
+				
+				queue_string( queue, Frame_block_sums,
+				                     encoded,
+				                     n_sums * encoded_block_sum_size,
+				                     r_id );
+				
+				queue.flush();
+				
+				n_sums = 0;
+			}
+		}
+		while ( n == block_size );
+	}
+	catch ( const p7::errno_t& err )
+	{
+		return -err;
 	}
 	
 	return 0;
 }
 
 static
-int write( session& s, uint8_t r_id, const request& r )
+int write( session& s, uint16_t r_id, const request& r )
 {
 	if ( ! writes_allowed )
 	{
@@ -329,6 +723,8 @@ int write( session& s, uint8_t r_id, const request& r )
 				if ( err == EPERM )
 				{
 					splat( *that, buffer, size );
+					
+					path_changed( r.path );
 					return 0;
 				}
 				
@@ -350,11 +746,13 @@ int write( session& s, uint8_t r_id, const request& r )
 		return -err;
 	}
 	
+	path_changed( r.path );
+	
 	return 0;
 }
 
 static
-int link( session& s, uint8_t r_id, const request& r )
+int link( session& s, uint16_t r_id, const request& r )
 {
 	if ( ! writes_allowed )
 	{
@@ -376,23 +774,43 @@ int link( session& s, uint8_t r_id, const request& r )
 		return -err;
 	}
 	
+	path_changed( path_2 );
+	
 	return 0;
 }
 
 static
-int start_read( session& s, uint8_t r_id, const request& r )
+int start_read( session& s, uint16_t r_id, const request& r )
 {
 	begin_task( &read, s, r_id );
 	
 	return 1;
 }
 
+static
+int start_sums( session& s, uint16_t r_id, const request& r )
+{
+	begin_task( &sums, s, r_id );
+	
+	return 1;
+}
+
+static
+int start_watch( session& s, uint16_t r_id, const request& r )
+{
+	begin_task( &watch, s, r_id );
+	
+	return 1;
+}
+
 enum arg_mask
 {
 	Mask_req    = (1 << Frame_request)
 	            | (1 << Frame_submit)
 	            | (1 << Frame_cancel),
 	
+	Mask_vers   = 1 << Frame_arg_features,
+	
 	Mask_path   = 1 << Frame_arg_path,
 	Mask_fd     = 1 << Frame_arg_fd,
 	
@@ -401,6 +819,7 @@ enum arg_mask
 	
 	Mask_count  = 1 << Frame_io_count,
 	Mask_offset = 1 << Frame_seek_offset,
+	Mask_block  = 1 << Frame_block_size,
 };
 
 static const char* arg_names[] =
@@ -408,7 +827,7 @@ static const char* arg_names[] =
 	"request",
 	"submit",
 	"cancel",
-	NULL,
+	"features",
 	"path",
 	NULL,
 	"fd",
@@ -416,6 +835,8 @@ static const char* arg_names[] =
 	"sent data",
 	"I/O byte count",
 	"seek offset",
+	NULL,
+	"block size",
 };
 
 static
@@ -439,15 +860,17 @@ struct request_desc
 static request_desc request_descs[] =
 {
 	{ 0 },
-	{ "vers" },
+	{ "vers",  &vers,        Mask_req | Mask_vers },
 	{ "auth" },
-	{ "stat",  &stat,       Mask_req | Mask_path },
-	{ "list",  &list,       Mask_req | Mask_path },
-	{ "read",  &start_read, Mask_req | Mask_path | Mask_count | Mask_offset },
-	{ "write", &write,      Mask_req | Mask_path | Mask_data  | Mask_offset },
-	{ "open",  &open,       Mask_req | Mask_path | Mask_fd },
-	{ "close", &close,      Mask_req | Mask_fd },
-	{ "link",  &link,       Mask_req | Mask_path },
+	{ "stat",  &stat,        Mask_req | Mask_path },
+	{ "list",  &list,        Mask_req | Mask_path },
+	{ "read",  &start_read,  Mask_req | Mask_path | Mask_count | Mask_offset },
+	{ "write", &write,       Mask_req | Mask_path | Mask_data  | Mask_offset },
+	{ "open",  &open,        Mask_req | Mask_path | Mask_fd },
+	{ "close", &close,       Mask_req | Mask_fd },
+	{ "link",  &link,        Mask_req | Mask_path },
+	{ "sums",  &start_sums,  Mask_req | Mask_path | Mask_block },
+	{ "watch", &start_watch, Mask_req | Mask_path },
 };
 
 static inline
@@ -461,12 +884,9 @@ bool request_is_implemented( uint8_t req_type )
 	return request_descs[ req_type ].handler != NULL;
 }
 
-int frame_handler( void* that, const frame_header& frame )
+static
+int handle_frame( session& s, const frame_header& frame )
 {
-	session& s = *(session*) that;
-	
-	s.check_tasks();
-	
 	switch ( frame.type )
 	{
 		case Frame_fatal:
@@ -495,9 +915,13 @@ int frame_handler( void* that, const frame_header& frame )
 	{
 		write( STDERR_FILENO, STR_LEN( "ping\n" ) );
 		
+		// A nonzero ping asks which version of the protocol we speak.
+		
+		const uint8_t version = frame.data ? protocol_version : 0;
+		
 		send_lock lock;
 		
-		queue_empty( s.queue(), Frame_pong );
+		queue_int( s.queue(), Frame_pong, version );
 		
 		s.queue().flush();
 		
@@ -518,7 +942,9 @@ int frame_handler( void* that, const frame_header& frame )
 		return -EINVAL;
 	}
 	
-	const uint8_t request_id = frame.r_id;
+	const uint16_t request_id = s.features() & Feature_wide_ids
+	                          ? get_request_id( frame )
+	                          : frame.r_id;
 	
 	request* req = s.get_request( request_id );
 	
@@ -549,6 +975,11 @@ int frame_handler( void* that, const frame_header& frame )
 	
 	if ( req == NULL )
 	{
+		if ( frame.type == Frame_cancel )
+		{
+			return 0;  // The request finished as the cancel crossed its result.
+		}
+		
 		fprintf( stderr, "Nonexistent request id %d\n", request_id );
 		return -ESRCH;
 	}
@@ -579,6 +1010,10 @@ int frame_handler( void* that, const frame_header& frame )
 			}
 			break;
 		
+		case Frame_arg_features:
+			r.features = get_u32( frame );
+			break;
+		
 		case Frame_arg_fd:
 			r.fd = get_u32( frame );
 			break;
@@ -595,32 +1030,42 @@ int frame_handler( void* that, const frame_header& frame )
 			r.offset = get_u64( frame );
 			break;
 		
+		case Frame_block_size:
+			r.block_size = get_u32( frame );
+			break;
+		
 		case Frame_submit:
-			int err;
-			
-			err = desc.handler( s, request_id, r );
-			
-			if ( err > 0 )
 			{
-				return 0;  // in progress
+				// Send the handler's entire response in one write.
+				
+				send_cork cork( s.queue() );
+				
+				const int err = desc.handler( s, request_id, r );
+				
+				if ( err > 0 )
+				{
+					return 0;  // in progress
+				}
+				
+				s.set_request( request_id, NULL );
+				
+				send_response( s.queue(), err, request_id );
 			}
-			
-			s.set_request( request_id, NULL );
-			
-			send_response( s.queue(), err, request_id );
 			break;
 		
 		case Frame_cancel:
 			if ( request* r = s.get_request( request_id ) )
 			{
-				if ( request_task* task = r->task )
-				{
-					task->cancel();
-				}
+				// A task that has sent its result already needs no other.
+				
+				const bool answered = r->task  &&  ! r->task->cancel();
 				
 				s.set_request( request_id, NULL );
 				
-				send_response( s.queue(), -ECANCELED, request_id );
+				if ( ! answered )
+				{
+					send_response( s.queue(), -ECANCELED, request_id );
+				}
 			}
 			
 			break;
@@ -632,4 +1077,41 @@ int frame_handler( void* that, const frame_header& frame )
 	return 0;
 }
 
+int frame_handler( void* that, const frame_header& frame )
+{
+	session& s = *(session*) that;
+	
+	s.check_tasks();
+	
+	return handle_frame( s, frame );
+}
+
+int frame_batch_handler( void*                that,
+                         const frame_header*  begin,
+                         const frame_header*& end )
+{
+	session& s = *(session*) that;
+	
+	s.check_tasks();
+	
+	/*
+		Responses to all the requests in the batch go out together, in one
+		write, when the cork is released.
+	*/
+	
+	send_cork cork( s.queue() );
+	
+	for ( const frame_header* it = begin;  it != end;  it = next_frame( *it ) )
+	{
+		if ( const int status = handle_frame( s, *it ) )
+		{
+			end = next_frame( *it );
+			
+			return status;
+		}
+	}
+	
+	return 0;
+}
+
 }  // namespace freemount
@@ -11,11 +11,16 @@ namespace freemount
 {
 	
 	extern bool writes_allowed;
+	extern bool verbose;  // log per-request statistics
 	
 	struct frame_header;
 	
 	int frame_handler( void* that, const frame_header& frame );
 	
+	int frame_batch_handler( void*                that,
+	                         const frame_header*  begin,
+	                         const frame_header*& end );
+	
 }
 
 #endif
@@ -12,32 +12,59 @@
 namespace freemount
 {
 	
-	void request_box::destroy_without_clearing()
+	session::~session()
 	{
-		delete its_request;
+		typedef request_map::iterator Iter;
+		
+		for ( Iter it = its_requests.begin();  it != its_requests.end();  ++it )
+		{
+			delete it->second;
+		}
 	}
 	
-	
-	session::~session()
+	void session::set_request( uint16_t id, request* r )
 	{
+		request_map::iterator it = its_requests.find( id );
+		
+		if ( it != its_requests.end() )
+		{
+			delete it->second;
+			
+			if ( r == NULL )
+			{
+				its_requests.erase( it );
+				return;
+			}
+			
+			it->second = r;
+		}
+		else if ( r != NULL )
+		{
+			its_requests[ id ] = r;
+		}
 	}
 	
 	void session::check_tasks()
 	{
-		for ( int i = 0;  i < n_requests;  ++i )
+		typedef request_map::iterator Iter;
+		
+		Iter it = its_requests.begin();
+		
+		while ( it != its_requests.end() )
 		{
-			if ( request* r = get_request( i ) )
+			request* r = it->second;
+			
+			request_task* task = r->task;
+			
+			if ( task  &&  task->done() )
+			{
+				delete r;  // deletes the task
+				
+				its_requests.erase( it++ );
+			}
+			else
 			{
-				if ( request_task* task = r->task )
-				{
-					if ( task->done() )
-					{
-						delete r->task;
-						r->task = NULL;
-						
-						set_request( i, NULL );
-					}
-				}
+				++it;
 			}
 		}
 	}
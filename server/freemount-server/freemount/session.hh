@@ -6,6 +6,12 @@
 #ifndef FREEMOUNT_SESSION_HH
 #define FREEMOUNT_SESSION_HH
 
+// Standard C++
+#include <map>
+
+// Standard C
+#include <stdint.h>
+
 // vfs
 #include "vfs/filehandle.hh"
 #include "vfs/filehandle_ptr.hh"
@@ -21,64 +27,21 @@ namespace freemount
 	
 	struct request;
 	
-	class request_box
-	{
-		private:
-			request* its_request;
-			
-			void destroy_without_clearing();
-			
-			// non-copyable
-			request_box           ( const request_box& );
-			request_box& operator=( const request_box& );
-		
-		public:
-			request_box() : its_request()
-			{
-			}
-			
-			~request_box()
-			{
-				destroy_without_clearing();
-			}
-			
-			void swap( request_box& that )
-			{
-				request* r = its_request;
-				
-				its_request = that.its_request;
-				
-				that.its_request = r;
-			}
-			
-			request* get() const  { return its_request; }
-			
-			void acquire( request* r )
-			{
-				destroy_without_clearing();
-				
-				its_request = r;
-			}
-			
-			void reset()
-			{
-				acquire( 0 );  // NULL
-			}
-	};
-	
-	inline void swap( request_box& a, request_box& b )
-	{
-		a.swap( b );
-	}
-	
 	
 	class session
 	{
 		private:
-			static const int n_requests   = 1 << 8;  // 256
+			/*
+				With wide request ids, a client may have up to 64Ki requests
+				outstanding, so the table holds only the ones in use.  It's
+				accessed only by the frame handler's thread.
+			*/
+			
+			typedef std::map< uint16_t, request* > request_map;
+			
 			static const int n_open_files = 1 << 8;  // 256
 			
-			request_box its_requests[ n_requests ];
+			request_map its_requests;
 			
 			vfs::filehandle_ptr its_open_files[ n_open_files ];
 			
@@ -87,6 +50,8 @@ namespace freemount
 			
 			send_queue its_queue;
 			
+			uint32_t its_features;  // frame handler's thread only; see begin_task()
+			
 			// non-copyable
 			session           ( const session& );
 			session& operator=( const session& );
@@ -100,6 +65,7 @@ namespace freemount
 				its_root( &root ),
 				its_cwd( &cwd ),
 				its_queue( send_fd ),
+				its_features(),
 				send_fd( send_fd )
 			{
 			}
@@ -111,26 +77,19 @@ namespace freemount
 			
 			send_queue& queue()  { return its_queue; }
 			
-			request* get_request( int i ) const
-			{
-				if ( unsigned( i ) >= n_requests )
-				{
-					return 0;  // NULL
-				}
-				
-				return its_requests[ i ].get();
-			}
+			uint32_t features() const  { return its_features; }
 			
-			void set_request( int i, request* r )
+			void set_features( uint32_t features )  { its_features = features; }
+			
+			request* get_request( uint16_t id ) const
 			{
-				if ( unsigned( i ) >= n_requests )
-				{
-					return;
-				}
+				request_map::const_iterator it = its_requests.find( id );
 				
-				its_requests[ i ].acquire( r );
+				return it != its_requests.end() ? it->second : 0;  // NULL
 			}
 			
+			void set_request( uint16_t id, request* r );
+			
 			vfs::filehandle* get_open_file( int i ) const
 			{
 				if ( unsigned( i ) >= n_open_files )
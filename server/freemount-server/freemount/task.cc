@@ -12,6 +12,7 @@
 // freemount
 #include "freemount/request.hh"
 #include "freemount/response.hh"
+#include "freemount/send_queue.hh"
 #include "freemount/session.hh"
 
 
@@ -27,13 +28,34 @@ bool request_task::done() const
 	return its_status >= 0;
 }
 
-request_task::request_task( req_func f, class session& s, uint8_t r_id )
+bool request_task::cancel()
+{
+	p7::lock k( its_mutex );
+	
+	if ( its_status >= 0 )
+	{
+		return false;  // The result has already been sent.
+	}
+	
+	its_cancelled = true;
+	
+	its_thread.cancel();
+	
+	return true;
+}
+
+request_task::request_task( req_func        f,
+                            class session&  s,
+                            const request&  r,
+                            uint16_t        r_id )
 :
 	f( f ),
 	s( s ),
+	r( r ),
 	r_id( r_id )
 {
-	its_status = -1;
+	its_status    = -1;
+	its_cancelled = false;
 	
 	its_thread.create( &start, this );
 }
@@ -48,9 +70,14 @@ void* request_task::start( void* param )
 {
 	request_task& task = *(request_task*) param;
 	
-	uint8_t id = task.r_id;
+	/*
+		The session's request table belongs to the frame handler's thread,
+		so the request is looked up there, in begin_task().
+	*/
+	
+	uint16_t id = task.r_id;
 	session& s = task.s;
-	request& r = *s.get_request( id );
+	const request& r = task.r;
 	
 	int result;
 	
@@ -67,18 +94,35 @@ void* request_task::start( void* param )
 	
 	p7::lock k( task.its_mutex );
 	
-	send_response( s.queue(), result, id );
+	/*
+		A request that was cancelled while we finished has been answered
+		with ECANCELED already, and gets no second result.
+	*/
+	
+	if ( ! task.its_cancelled )
+	{
+		send_queue queue( s.send_fd );
+		
+		send_response( queue, result, id );
+	}
 	
 	task.its_status = 0;
 	
 	return NULL;
 }
 
-void begin_task( req_func f, session& s, uint8_t r_id )
+void begin_task( req_func f, session& s, uint16_t r_id )
 {
 	request& r = *s.get_request( r_id );
 	
-	r.task = new request_task( f, s, r_id );
+	/*
+		A later vers request may change the session's features, so give
+		the task its own copy, made before its thread starts.
+	*/
+	
+	r.features = s.features();
+	
+	r.task = new request_task( f, s, r, r_id );
 }
 
 }  // namespace freemount
@@ -19,7 +19,7 @@ namespace freemount
 	struct request;
 	class session;
 	
-	typedef int (*req_func)( session& s, uint8_t r_id, const request& r );
+	typedef int (*req_func)( session& s, uint16_t r_id, const request& r );
 	
 	class request_task
 	{
@@ -29,25 +29,30 @@ namespace freemount
 			
 			const req_func  f;
 			session&        s;
-			const uint8_t   r_id;
+			const request&  r;
+			const uint16_t  r_id;
 		
 		private:
 			int        its_status;  // -1 until done, then 0 or errno
+			bool       its_cancelled;
 			mutable m  its_mutex;
 			p7_thread  its_thread;
 			
 			static void* start( void* param );
 		
 		public:
-			request_task( req_func f, class session& s, uint8_t r_id );
+			request_task( req_func        f,
+			              class session&  s,
+			              const request&  r,
+			              uint16_t        r_id );
 			~request_task();
 			
 			bool done() const;
 			
-			void cancel()  { its_thread.cancel(); }
+			bool cancel();
 	};
 	
-	void begin_task( req_func f, session& s, uint8_t r_id );
+	void begin_task( req_func f, session& s, uint16_t r_id );
 	
 }
 
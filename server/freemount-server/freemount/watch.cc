@@ -0,0 +1,507 @@
+/*
+	freemount/watch.cc
+	------------------
+*/
+
+#include "freemount/watch.hh"
+
+// POSIX
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+// Standard C++
+#include <algorithm>
+#include <list>
+#include <vector>
+
+// Standard C
+#include <errno.h>
+#include <string.h>
+
+// plus
+#include "plus/var_string.hh"
+
+// poseven
+#include "poseven/types/errno_t.hh"
+#include "poseven/types/thread.hh"
+
+// vfs
+#include "vfs/node.hh"
+#include "vfs/functions/resolve_pathname.hh"
+#include "vfs/primitives/stat.hh"
+
+// freemount
+#include "freemount/queue_utils.hh"
+#include "freemount/request.hh"
+#include "freemount/send_lock.hh"
+#include "freemount/send_queue.hh"
+#include "freemount/session.hh"
+
+
+namespace freemount {
+
+namespace p7 = poseven;
+
+
+const char* native_root = NULL;
+
+
+/*
+	Polling watches stat their node this often (in milliseconds), and
+	report a change if its mode, link count, size, or mtime differs.
+*/
+
+const int poll_interval = 1000;
+
+
+class watcher
+{
+	private:
+		plus::string  its_path;  // without a trailing slash
+		int           its_pipe[ 2 ];
+		
+		p7::mutex  its_mutex;
+		
+		std::vector< plus::string > its_pending;
+		
+		// non-copyable
+		watcher           ( const watcher& );
+		watcher& operator=( const watcher& );
+	
+	public:
+		watcher( const plus::string& path );
+		~watcher();
+		
+		const plus::string& path() const  { return its_path; }
+		
+		int wake_fd() const  { return its_pipe[ 0 ]; }
+		
+		void changed( const plus::string& name );
+		
+		void take( std::vector< plus::string >& names );
+};
+
+watcher::watcher( const plus::string& path ) : its_path( path )
+{
+	size_t size = path.size();
+	
+	while ( size > 0  &&  path.data()[ size - 1 ] == '/' )
+	{
+		--size;
+	}
+	
+	its_path = plus::string( path.data(), size );
+	
+	if ( pipe( its_pipe ) < 0 )
+	{
+		p7::throw_errno( errno );
+	}
+}
+
+watcher::~watcher()
+{
+	close( its_pipe[ 0 ] );
+	close( its_pipe[ 1 ] );
+}
+
+void watcher::changed( const plus::string& name )
+{
+	p7::lock k( its_mutex );
+	
+	if ( its_pending.empty() )
+	{
+		const char wake = 0;
+		
+		::write( its_pipe[ 1 ], &wake, sizeof wake );
+	}
+	
+	its_pending.push_back( name );
+}
+
+void watcher::take( std::vector< plus::string >& names )
+{
+	p7::lock k( its_mutex );
+	
+	if ( ! its_pending.empty() )
+	{
+		char wake;
+		
+		::read( its_pipe[ 0 ], &wake, sizeof wake );
+		
+		names.insert( names.end(), its_pending.begin(), its_pending.end() );
+		
+		its_pending.clear();
+	}
+}
+
+/*
+	Polling watches register here, so path_changed() can find them.
+*/
+
+typedef std::list< watcher* > watcher_list;
+
+static p7::mutex     the_watchers_mutex;
+static watcher_list  the_watchers;
+
+class watcher_registration
+{
+	private:
+		watcher_list::iterator its_it;
+		
+		// non-copyable
+		watcher_registration           ( const watcher_registration& );
+		watcher_registration& operator=( const watcher_registration& );
+	
+	public:
+		watcher_registration( watcher& w )
+		{
+			p7::lock k( the_watchers_mutex );
+			
+			its_it = the_watchers.insert( the_watchers.end(), &w );
+		}
+		
+		~watcher_registration()
+		{
+			p7::lock k( the_watchers_mutex );
+			
+			the_watchers.erase( its_it );
+		}
+};
+
+static inline
+bool equal( const char* a, size_t a_size, const plus::string& b )
+{
+	return a_size == b.size()  &&  memcmp( a, b.data(), a_size ) == 0;
+}
+
+void path_changed( const plus::string& path )
+{
+	const char* begin = path.data();
+	const char* end   = begin + path.size();
+	
+	while ( end > begin  &&  end[ -1 ] == '/' )
+	{
+		--end;
+	}
+	
+	const char* name = end;
+	
+	while ( name > begin  &&  name[ -1 ] != '/' )
+	{
+		--name;
+	}
+	
+	// If there's no slash, parent_size is -1 and never matches.
+	
+	const size_t path_size   = end - begin;
+	const size_t parent_size = name - begin - 1;
+	
+	p7::lock k( the_watchers_mutex );
+	
+	typedef watcher_list::const_iterator Iter;
+	
+	for ( Iter it = the_watchers.begin();  it != the_watchers.end();  ++it )
+	{
+		watcher& w = **it;
+		
+		if ( equal( begin, path_size, w.path() ) )
+		{
+			w.changed( plus::string() );
+		}
+		else if ( name > begin  &&  equal( begin, parent_size, w.path() ) )
+		{
+			w.changed( plus::string( name, end - name ) );
+		}
+	}
+}
+
+struct snapshot
+{
+	bool      exists;
+	mode_t    mode;
+	nlink_t   nlink;
+	off_t     size;
+	time_t    mtime;
+	dev_t     dev;
+	ino_t     ino;
+};
+
+static
+snapshot take_snapshot( const session& s, const plus::string& path )
+{
+	snapshot result = { 0 };
+	
+	try
+	{
+		vfs::node_ptr that = vfs::resolve_pathname( s.root(), path, s.cwd() );
+		
+		struct stat sb;
+		
+		stat( *that, sb );
+		
+		result.exists = true;
+		result.mode   = sb.st_mode;
+		result.nlink  = sb.st_nlink;
+		result.size   = sb.st_size;
+		result.mtime  = sb.st_mtime;
+		result.dev    = sb.st_dev;
+		result.ino    = sb.st_ino;
+	}
+	catch ( const p7::errno_t& err )
+	{
+		if ( err != ENOENT )
+		{
+			throw;
+		}
+	}
+	
+	return result;
+}
+
+static inline
+bool operator!=( const snapshot& a, const snapshot& b )
+{
+	return a.exists != b.exists
+	    || a.mode   != b.mode
+	    || a.nlink  != b.nlink
+	    || a.size   != b.size
+	    || a.mtime  != b.mtime
+	    || a.dev    != b.dev
+	    || a.ino    != b.ino;
+}
+
+#ifdef __linux__
+
+class native_watch
+{
+	private:
+		int its_fd;
+		
+		// non-copyable
+		native_watch           ( const native_watch& );
+		native_watch& operator=( const native_watch& );
+	
+	public:
+		native_watch( const plus::string& path, const snapshot& snap );
+		
+		~native_watch()
+		{
+			close();
+		}
+		
+		int get() const  { return its_fd; }
+		
+		void close();
+		
+		void read( std::vector< plus::string >& names );
+};
+
+/*
+	As with open_native() in server.cc, we watch the native path only if it
+	can't leave the native root, and only if it names the very file that
+	the vfs resolved.  Otherwise, we poll.
+*/
+
+native_watch::native_watch( const plus::string& path, const snapshot& snap )
+:
+	its_fd( -1 )
+{
+	if ( native_root == NULL  ||  path[ 0 ] != '/'  ||  strstr( path.c_str(), "/.." ) )
+	{
+		return;
+	}
+	
+	const uint32_t mask = IN_ATTRIB
+	                    | IN_CLOSE_WRITE
+	                    | IN_CREATE
+	                    | IN_DELETE
+	                    | IN_DELETE_SELF
+	                    | IN_MODIFY
+	                    | IN_MOVE_SELF
+	                    | IN_MOVED_FROM
+	                    | IN_MOVED_TO;
+	
+	plus::var_string native_path = native_root;
+	
+	native_path += path;
+	
+	struct stat st;
+	
+	if ( stat( native_path.c_str(), &st ) < 0  ||  st.st_dev != snap.dev
+	                                           ||  st.st_ino != snap.ino )
+	{
+		return;
+	}
+	
+	its_fd = inotify_init();
+	
+	if ( its_fd >= 0  &&  inotify_add_watch( its_fd, native_path.c_str(), mask ) < 0 )
+	{
+		close();
+	}
+}
+
+void native_watch::close()
+{
+	if ( its_fd >= 0 )
+	{
+		::close( its_fd );
+		
+		its_fd = -1;
+	}
+}
+
+void native_watch::read( std::vector< plus::string >& names )
+{
+	union
+	{
+		inotify_event  event;
+		char           bytes[ 4096 ];
+	}
+	buffer;
+	
+	const ssize_t n_read = ::read( its_fd, buffer.bytes, sizeof buffer );
+	
+	if ( n_read <= 0 )
+	{
+		return;
+	}
+	
+	const char* p   = buffer.bytes;
+	const char* end = p + n_read;
+	
+	while ( p < end )
+	{
+		const inotify_event& event = *(const inotify_event*) p;
+		
+		if ( event.mask & IN_IGNORED )
+		{
+			/*
+				The path was deleted or moved away.  Fall back to polling,
+				so we notice if it reappears.
+			*/
+			
+			names.push_back( plus::string() );
+			
+			close();
+			return;
+		}
+		
+		// The name is absent for events on the watched path itself.
+		
+		const size_t len = event.len ? strnlen( event.name, event.len ) : 0;
+		
+		names.push_back( plus::string( event.name, len ) );
+		
+		p += sizeof (inotify_event) + event.len;
+	}
+}
+
+#else
+
+struct native_watch
+{
+	native_watch( const plus::string& path, const snapshot& snap )  {}
+	
+	int get() const  { return -1; }
+	
+	void read( std::vector< plus::string >& names )  {}
+};
+
+#endif
+
+int watch( session& s, uint16_t r_id, const request& r )
+{
+	// Like read(), we run in our own thread and use our own queue.
+	
+	send_queue queue( s.send_fd );
+	
+	const plus::string& path = r.path;
+	
+	snapshot last = take_snapshot( s, path );
+	
+	if ( ! last.exists )
+	{
+		return -ENOENT;
+	}
+	
+	watcher w( path );
+	
+	watcher_registration registration( w );
+	
+	native_watch native( path, last );
+	
+	std::vector< plus::string > names;
+	
+	while ( true )
+	{
+		const bool polling = native.get() < 0;
+		
+		pollfd fds[ 2 ] =
+		{
+			{ w.wake_fd(), POLLIN },
+			{ native.get(), POLLIN },
+		};
+		
+		const int n_fds = polling ? 1 : 2;
+		
+		const int ready = poll( fds, n_fds, polling ? poll_interval : -1 );
+		
+		p7::thread::testcancel();
+		
+		if ( ready < 0  &&  errno != EINTR )
+		{
+			return -errno;
+		}
+		
+		names.clear();
+		
+		w.take( names );
+		
+		if ( ! polling )
+		{
+			if ( fds[ 1 ].revents )
+			{
+				native.read( names );
+			}
+		}
+		else
+		{
+			const snapshot next = take_snapshot( s, path );
+			
+			if ( next != last )
+			{
+				names.push_back( plus::string() );
+				
+				last = next;
+			}
+		}
+		
+		if ( names.empty() )
+		{
+			continue;
+		}
+		
+		std::sort( names.begin(), names.end() );
+		
+		names.erase( std::unique( names.begin(), names.end() ), names.end() );
+		
+		send_lock lock;
+		
+		for ( size_t i = 0;  i < names.size();  ++i )
+		{
+			const plus::string& name = names[ i ];
+			
+			queue_string( queue, Frame_watch_event, name.data(), name.size(), r_id );
+		}
+		
+		queue.flush();
+	}
+}
+
+}  // namespace freemount
@@ -0,0 +1,49 @@
+/*
+	freemount/watch.hh
+	------------------
+*/
+
+#ifndef FREEMOUNT_WATCH_HH
+#define FREEMOUNT_WATCH_HH
+
+// Standard C
+#include <stdint.h>
+
+// plus
+#include "plus/string.hh"
+
+
+namespace freemount
+{
+	
+	struct request;
+	class session;
+	
+	/*
+		The native directory backing the vfs root, if any.  Watches on
+		nodes under it use inotify (where available); all others poll.
+	*/
+	
+	extern const char* native_root;
+	
+	/*
+		Synthetic nodes have no native file to watch, so whatever changes
+		one should call path_changed(), which wakes any watches on the path
+		or its parent directory immediately.
+	*/
+	
+	void path_changed( const plus::string& path );
+	
+	/*
+		A watch request runs until it's canceled, sending a
+		Frame_watch_event whenever the path changes.  The payload is the
+		name of the changed entry in a watched directory, or empty if it's
+		the path itself.  Events are hints to re-read, not a change log:
+		They may be coalesced or repeated.
+	*/
+	
+	int watch( session& s, uint16_t r_id, const request& r );
+	
+}
+
+#endif
@@ -32,6 +32,7 @@
 // freemountd
 #include "freemount/server.hh"
 #include "freemount/session.hh"
+#include "freemount/watch.hh"
 
 
 using namespace command::constants;
@@ -40,9 +41,10 @@ using namespace freemount;
 
 enum
 {
-	Option_quiet  = 'q',
-	Option_user   = 'u',
-	Option_window = 'w',
+	Option_quiet   = 'q',
+	Option_user    = 'u',
+	Option_verbose = 'v',
+	Option_window  = 'w',
 	
 	Option_last_byte = 255,
 	
@@ -52,11 +54,12 @@ enum
 
 static command::option options[] =
 {
-	{ "quiet",  Option_quiet },
-	{ "root",   Option_root,   Param_required },
-	{ "rw",     Option_rw   },
-	{ "user",   Option_user },
-	{ "window", Option_window, Param_required },
+	{ "quiet",   Option_quiet   },
+	{ "root",    Option_root,   Param_required },
+	{ "rw",      Option_rw      },
+	{ "user",    Option_user    },
+	{ "verbose", Option_verbose },
+	{ "window",  Option_window, Param_required },
 	{ NULL }
 };
 
@@ -112,6 +115,10 @@ char* const* get_options( char* const* argv )
 				the_user = 0;
 				break;
 			
+			case Option_verbose:
+				verbose = true;
+				break;
+			
 			case Option_window:
 				set_congestion_window( command::global_result.param );
 				break;
@@ -155,9 +162,11 @@ int main( int argc, char* const* argv )
 	install_empty_signal_handler( thread_interrupt_signal );
 	thread::set_interrupt_signal( thread_interrupt_signal );
 	
+	native_root = the_native_root_directory;
+	
 	session s( STDOUT_FILENO, root(), root() );
 	
-	data_receiver r( &frame_handler, &s );
+	data_receiver r( &frame_batch_handler, &s );
 	
 	int looped = run_event_loop( r, STDIN_FILENO );
 	
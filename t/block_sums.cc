@@ -0,0 +1,67 @@
+/*
+	block_sums.cc
+	-------------
+*/
+
+// Standard C
+#include <string.h>
+
+// freemount
+#include "freemount/block_sums.hh"
+
+// tap-out
+#include "tap/test.hh"
+
+
+static const unsigned n_tests = 2 + 1;
+
+
+using namespace freemount;
+
+
+static void rolling()
+{
+	const char data[] = "The quick brown fox jumps over the lazy dog.";
+	
+	const size_t window = 16;
+	
+	rolling_sum sum( data, window );
+	
+	bool all_match = true;
+	
+	for ( size_t i = 1;  i + window < sizeof data;  ++i )
+	{
+		sum.roll( data[ i - 1 ], data[ i - 1 + window ] );
+		
+		all_match = all_match  &&  sum.get() == weak_sum( data + i, window );
+	}
+	
+	EXPECT( all_match );
+	
+	EXPECT( strong_sum( data, window ) != strong_sum( data + 1, window ) );
+}
+
+static void encoding()
+{
+	const block_sum sum = { 0x12345678, 0x0123456789ABCDEFull };
+	
+	char encoded[ encoded_block_sum_size ];
+	
+	encode_block_sum( encoded, sum );
+	
+	block_sum decoded;
+	
+	decode_block_sum( encoded, decoded );
+	
+	EXPECT( decoded.weak == sum.weak  &&  decoded.strong == sum.strong  &&  encoded[ 0 ] == 0x12 );
+}
+
+int main( int argc, char** argv )
+{
+	tap::start( "block_sums", n_tests );
+	
+	rolling();
+	encoding();
+	
+	return 0;
+}
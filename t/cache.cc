@@ -0,0 +1,223 @@
+/*
+	cache.cc
+	--------
+*/
+
+// POSIX
+#include <pthread.h>
+#include <unistd.h>
+
+// Standard C
+#include <string.h>
+
+// freemount
+#include "freemount/event_loop.hh"
+#include "freemount/frame_size.hh"
+#include "freemount/queue_utils.hh"
+#include "freemount/receiver.hh"
+#include "freemount/send_queue.hh"
+
+// freemount-client
+#include "freemount/cache.hh"
+
+// tap-out
+#include "tap/check.hh"
+#include "tap/test.hh"
+
+
+static const unsigned n_tests = 2 + 2 + 2 + 2 + 2 + 2;
+
+
+using namespace freemount;
+
+
+/*
+	A stand-in server, on its own thread, that serves one file whose
+	contents and mtime the tests change, and counts the requests it gets.
+*/
+
+static int to_server[ 2 ];
+static int to_client[ 2 ];
+
+static const char* the_contents = "hello";
+static uint64_t    the_mtime    = 100;
+
+static int n_vers;
+static int n_stats;
+static int n_reads;
+
+static uint8_t the_request_type;
+
+static
+int server_handler( void* that, const frame_header& frame )
+{
+	send_queue& queue = *(send_queue*) that;
+	
+	const uint16_t r_id = get_request_id( frame );
+	
+	const uint32_t size = strlen( the_contents );
+	
+	switch ( frame.type )
+	{
+		case Frame_ping:
+			queue_int( queue, Frame_pong, protocol_version );
+			break;
+		
+		case Frame_request:
+			the_request_type = frame.data;
+			return 0;
+		
+		case Frame_submit:
+			switch ( the_request_type )
+			{
+				case req_vers:
+					++n_vers;
+					
+					queue_int( queue, Frame_features, Feature_stat_mtime, r_id );
+					break;
+				
+				case req_stat:
+					++n_stats;
+					
+					queue_int( queue, Frame_stat_mode,  0100644,   r_id );
+					queue_int( queue, Frame_stat_size,  size,      r_id );
+					queue_int( queue, Frame_stat_mtime, the_mtime, r_id );
+					break;
+				
+				case req_read:
+					++n_reads;
+					
+					queue_int   ( queue, Frame_stat_size, size,               r_id );
+					queue_string( queue, Frame_recv_data, the_contents, size, r_id );
+					break;
+				
+				default:
+					break;
+			}
+			
+			queue_int( queue, Frame_result, 0u, r_id );
+			break;
+		
+		default:
+			return 0;
+	}
+	
+	queue.flush();
+	
+	return 0;
+}
+
+static
+void* serve( void* )
+{
+	send_queue queue( to_client[ 1 ] );
+	
+	data_receiver r( &server_handler, &queue );
+	
+	run_event_loop( r, to_server[ 0 ] );
+	
+	return NULL;
+}
+
+static client_cache cache( client_cache::default_budget, 200 );
+
+static
+plus::string get()
+{
+	return cache.get( to_client[ 0 ], to_server[ 1 ], "/f" );
+}
+
+static
+void miss()
+{
+	EXPECT( get() == "hello" );
+	
+	// The first fetch negotiates Feature_stat_mtime.
+	
+	EXPECT( n_vers == 1  &&  n_stats == 1  &&  n_reads == 1 );
+}
+
+static
+void hit()
+{
+	EXPECT( get() == "hello" );
+	
+	EXPECT( n_vers == 1  &&  n_stats == 1  &&  n_reads == 1 );
+}
+
+static
+void revalidate()
+{
+	usleep( 300 * 1000 );  // past the TTL
+	
+	EXPECT( get() == "hello" );
+	
+	// A stat alone confirms that the data is unchanged.
+	
+	EXPECT( n_stats == 2  &&  n_reads == 1 );
+}
+
+static
+void changed()
+{
+	usleep( 300 * 1000 );
+	
+	the_contents = "world!";
+	the_mtime    = 200;
+	
+	EXPECT( get() == "world!" );
+	
+	// A stat finds the change, and the data is fetched again.
+	
+	EXPECT( n_stats == 4  &&  n_reads == 2 );
+}
+
+static
+void invalidated()
+{
+	the_contents = "again";
+	
+	cache.invalidate( "/f" );
+	
+	EXPECT( get() == "again" );
+	
+	EXPECT( n_vers == 1  &&  n_stats == 5  &&  n_reads == 3 );
+}
+
+static
+void same_size()
+{
+	usleep( 300 * 1000 );
+	
+	the_contents = "AGAIN";
+	the_mtime   += 1;  // within the same second
+	
+	EXPECT( get() == "AGAIN" );
+	
+	EXPECT( n_stats == 7  &&  n_reads == 4 );
+}
+
+int main( int argc, char** argv )
+{
+	tap::start( "cache", n_tests );
+	
+	CHECK( pipe( to_server ) );
+	CHECK( pipe( to_client ) );
+	
+	pthread_t server;
+	
+	pthread_create( &server, NULL, &serve, NULL );
+	
+	miss();
+	hit();
+	revalidate();
+	changed();
+	invalidated();
+	same_size();
+	
+	close( to_server[ 1 ] );
+	
+	pthread_join( server, NULL );
+	
+	return 0;
+}
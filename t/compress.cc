@@ -0,0 +1,140 @@
+/*
+	compress.cc
+	-----------
+*/
+
+// Standard C
+#include <errno.h>
+#include <string.h>
+
+// freemount
+#include "freemount/compress.hh"
+#include "freemount/frame_size.hh"
+#include "freemount/receiver.hh"
+
+// tap-out
+#include "tap/test.hh"
+
+
+static const unsigned n_tests = 3 + 2 + 2 + 3;
+
+
+using namespace freemount;
+
+
+static char text[ 4096 ];
+static char noise[ 4096 ];
+
+static char packed[ 8192 ];
+static char unpacked[ 8192 ];
+
+static void make_inputs()
+{
+	const char line[] = "The quick brown fox jumps over the lazy dog.\n";
+	
+	for ( size_t i = 0;  i < sizeof text;  ++i )
+	{
+		text[ i ] = line[ i % (sizeof line - 1) ];
+	}
+	
+	uint32_t x = 12345;
+	
+	for ( size_t i = 0;  i < sizeof noise;  ++i )
+	{
+		x = x * 1103515245 + 12345;
+		
+		noise[ i ] = x >> 24;
+	}
+}
+
+static void round_trip()
+{
+	const size_t n = compress_block( text, sizeof text, packed, sizeof packed );
+	
+	EXPECT( n > 0  &&  n < sizeof text / 4 );
+	
+	const long m = decompress_block( packed, n, unpacked, sizeof unpacked );
+	
+	EXPECT( m == long( sizeof text ) );
+	
+	EXPECT( memcmp( text, unpacked, sizeof text ) == 0 );
+}
+
+static void incompressible()
+{
+	EXPECT( looks_incompressible( noise, sizeof noise ) );
+	
+	EXPECT( ! looks_incompressible( text, sizeof text ) );
+}
+
+static void malformed()
+{
+	const size_t n = compress_block( text, sizeof text, packed, sizeof packed );
+	
+	// Too little room for the output
+	
+	EXPECT( decompress_block( packed, n, unpacked, sizeof text - 1 ) == -1 );
+	
+	// Truncated input
+	
+	EXPECT( decompress_block( packed, n - 3, unpacked, sizeof unpacked ) < long( sizeof text ) );
+}
+
+static int n_frames;
+static bool data_matches;
+
+static int frame_handler( void* that, const frame_header& frame )
+{
+	++n_frames;
+	
+	data_matches = frame.type == Frame_recv_data         &&
+	               get_size( frame ) == sizeof text      &&
+	               memcmp( get_data( frame ), text, sizeof text ) == 0;
+	
+	return 0;
+}
+
+static void received()
+{
+	// A Frame_recv_zdata frame, as data_compressor would send it
+	
+	static char frame[ 8 + 4 + sizeof packed ];
+	
+	frame_header& h = *(frame_header*) frame;
+	
+	h.type = Frame_recv_zdata;
+	
+	const uint32_t big_size = iota::big_u32( sizeof text );
+	
+	memcpy( frame + 8, &big_size, 4 );
+	
+	const size_t n = compress_block( text, sizeof text, frame + 12, sizeof packed );
+	
+	set_payload_size( h, 4 + n );
+	
+	data_receiver r( &frame_handler, NULL );
+	
+	EXPECT( r.recv_bytes( frame, get_frame_size( h ) ) == 0 );
+	
+	EXPECT( n_frames == 1  &&  data_matches );
+	
+	// Corrupt the size prefix.
+	
+	frame[ 8 ] = 0x7F;
+	
+	EXPECT( r.recv_bytes( frame, get_frame_size( h ) ) == -EBADMSG );
+}
+
+int main( int argc, char** argv )
+{
+	tap::start( "compress", n_tests );
+	
+	make_inputs();
+	
+	round_trip();
+	incompressible();
+	malformed();
+	received();
+	
+	return 0;
+}
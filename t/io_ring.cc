@@ -0,0 +1,116 @@
+/*
+	io_ring.cc
+	----------
+*/
+
+// POSIX
+#include <unistd.h>
+
+// Standard C
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+// freemount
+#include "freemount/io_ring.hh"
+
+// tap-out
+#include "tap/check.hh"
+#include "tap/test.hh"
+
+
+static const unsigned n_tests = 1 + 3;
+
+
+using namespace freemount;
+
+
+static void write_through()
+{
+	int pipes[ 2 ];
+	
+	CHECK( pipe( pipes ) );
+	
+	char hello[] = "hello";
+	char world[] = " world";
+	
+	iovec iov[ 2 ] =
+	{
+		{ hello, 5 },
+		{ world, 6 },
+	};
+	
+	io_ring ring;
+	
+	// This works whether or not io_uring does.
+	
+	ring.writev_in_full( pipes[ 1 ], iov, 2 );
+	
+	char buffer[ 16 ];
+	
+	const ssize_t n_read = read( pipes[ 0 ], buffer, sizeof buffer );
+	
+	EXPECT( n_read == 11  &&  memcmp( buffer, "hello world", 11 ) == 0 );
+	
+	close( pipes[ 0 ] );
+	close( pipes[ 1 ] );
+}
+
+static void read_and_write()
+{
+	char path[] = "/tmp/io_ring.XXXXXX";
+	
+	int file = mkstemp( path );
+	
+	CHECK( file );
+	
+	unlink( path );
+	
+	CHECK( write( file, "0123456789", 10 ) );
+	
+	int pipes[ 2 ];
+	
+	CHECK( pipe( pipes ) );
+	
+	char data[] = "block";
+	
+	iovec iov = { data, 5 };
+	
+	char buffer[ 16 ] = { 0 };
+	
+	io_ring ring;
+	
+	if ( ! ring.usable() )
+	{
+		ring.prep_pread( file, buffer, 4, 3, 0 );
+		
+		EXPECT( ring.run() == -ENOSYS );
+		EXPECT( ring.result( 0 ) == -ENOSYS );
+		EXPECT( buffer[ 0 ] == '\0' );
+	}
+	else
+	{
+		ring.prep_pread ( file,       buffer, 4, 3, 0 );
+		ring.prep_writev( pipes[ 1 ], &iov,   1,    1 );
+		
+		EXPECT( ring.run() == 0 );
+		
+		EXPECT( ring.result( 0 ) == 4  &&  memcmp( buffer, "3456", 4 ) == 0 );
+		
+		EXPECT( ring.result( 1 ) == 5  &&  read( pipes[ 0 ], buffer, 16 ) == 5 );
+	}
+	
+	close( pipes[ 0 ] );
+	close( pipes[ 1 ] );
+	close( file );
+}
+
+int main( int argc, char** argv )
+{
+	tap::start( "io_ring", n_tests );
+	
+	write_through();
+	read_and_write();
+	
+	return 0;
+}
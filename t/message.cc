@@ -0,0 +1,182 @@
+/*
+	message.cc
+	----------
+*/
+
+// POSIX
+#include <unistd.h>
+
+// Standard C
+#include <string.h>
+
+// freemount
+#include "freemount/message.hh"
+#include "freemount/queue_utils.hh"
+#include "freemount/send_queue.hh"
+
+// tap-out
+#include "tap/check.hh"
+#include "tap/test.hh"
+
+
+static const unsigned n_tests = 2 + 2 + 2 + 3 + 2;
+
+
+using namespace freemount;
+
+
+static int fds[ 2 ];
+
+static char expected[ 256 ];
+static char received[ 256 ];
+
+static ssize_t n_expected;
+
+static void expect_queued()
+{
+	n_expected = CHECK( read( fds[0], expected, sizeof expected ) );
+}
+
+static bool received_matches()
+{
+	ssize_t n = CHECK( read( fds[0], received, sizeof received ) );
+	
+	return n == n_expected  &&  memcmp( received, expected, n ) == 0;
+}
+
+static void path_message()
+{
+	{
+		send_queue queue( fds[1] );
+		
+		queue_int   ( queue, Frame_request, req_stat,      7 );
+		queue_string( queue, Frame_arg_path, "/etc/motd", 9, 7 );
+		queue_empty ( queue, Frame_submit,                 7 );
+		
+		queue.flush();
+	}
+	
+	expect_queued();
+	
+	EXPECT( n_expected == 8 + 8 + 12 + 8 );
+	
+	message< arg_path > m( req_stat, arg_path( "/etc/motd", 9 ), 7 );
+	
+	m.send( fds[1] );
+	
+	EXPECT( received_matches() );
+}
+
+static void int_message()
+{
+	{
+		send_queue queue( fds[1] );
+		
+		queue_int   ( queue, Frame_request,     req_read       );
+		queue_string( queue, Frame_arg_path,    "/x", 2        );
+		queue_int   ( queue, Frame_seek_offset, 0x123456789ull );
+		queue_empty ( queue, Frame_submit                      );
+		
+		queue.flush();
+	}
+	
+	expect_queued();
+	
+	EXPECT( n_expected == 8 + 12 + 16 + 8 );
+	
+	typedef message< arg_path, arg_offset > read_message;
+	
+	read_message m( req_read, arg_path( "/x", 2 ), arg_offset( 0x123456789ull ), 0 );
+	
+	m.send( fds[1] );
+	
+	EXPECT( received_matches() );
+}
+
+static void queued_message()
+{
+	{
+		send_queue queue( fds[1] );
+		
+		queue_int  ( queue, Frame_request, req_close, 3 );
+		queue_int  ( queue, Frame_arg_fd,  300,       3 );
+		queue_empty( queue, Frame_submit,             3 );
+		
+		queue.flush();
+	}
+	
+	expect_queued();
+	
+	EXPECT( n_expected == 8 + 12 + 8 );
+	
+	send_queue queue( fds[1] );
+	
+	message< arg_fd > m( req_close, arg_fd( 300 ), 3 );
+	
+	m.queue( queue );
+	
+	queue.flush();
+	
+	EXPECT( received_matches() );
+}
+
+static void wide_id_message()
+{
+	const uint16_t id = 0x1234;
+	
+	message< arg_features > m( req_vers, arg_features( Feature_wide_ids ), id );
+	
+	m.send( fds[1] );
+	
+	const ssize_t n = CHECK( read( fds[0], received, sizeof received ) );
+	
+	EXPECT( n == 8 + 8 + 8 );
+	
+	const frame_header& request = *(const frame_header*) received;
+	const frame_header& submit  = *(const frame_header*) (received + 16);
+	
+	EXPECT( request.r_id == 0x34  &&  request._6 == 0x12 );
+	
+	EXPECT( get_request_id( submit ) == id );
+}
+
+static bool encodes( uint32_t size, uint32_t max_payload )
+{
+	static char data[ max_plain_payload + 1 ];
+	
+	try
+	{
+		message< arg_data > m( req_write, arg_data( data, size ), 0, max_payload );
+	}
+	catch ( const payload_too_large& )
+	{
+		return false;
+	}
+	
+	return true;
+}
+
+static void oversized_message()
+{
+	EXPECT( ! encodes( max_plain_payload + 1, max_plain_payload ) );
+	
+	EXPECT( encodes( max_plain_payload + 1, max_jumbo_payload ) );
+}
+
+int main( int argc, char** argv )
+{
+	tap::start( "message", n_tests );
+	
+	CHECK( pipe( fds ) );
+	
+	path_message();
+	int_message();
+	queued_message();
+	wide_id_message();
+	oversized_message();
+	
+	close( fds[0] );
+	close( fds[1] );
+	
+	return 0;
+}
@@ -0,0 +1,123 @@
+/*
+	pass_fd.cc
+	----------
+*/
+
+// POSIX
+#include <unistd.h>
+#include <sys/socket.h>
+
+// Standard C
+#include <string.h>
+
+// freemount
+#include "freemount/pass_fd.hh"
+
+// tap-out
+#include "tap/check.hh"
+#include "tap/test.hh"
+
+
+static const unsigned n_tests = 2 + 3 + 2;
+
+
+using namespace freemount;
+
+
+static void unix_sockets()
+{
+	int fds[ 2 ];
+	
+	CHECK( pipe( fds ) );
+	
+	EXPECT( ! is_unix_socket( fds[ 0 ] ) );
+	
+	close( fds[ 0 ] );
+	close( fds[ 1 ] );
+	
+	CHECK( socketpair( AF_UNIX, SOCK_STREAM, 0, fds ) );
+	
+	EXPECT( is_unix_socket( fds[ 0 ] ) );
+	
+	close( fds[ 0 ] );
+	close( fds[ 1 ] );
+}
+
+static void passing()
+{
+	int socks[ 2 ];
+	int pipes[ 2 ];
+	
+	CHECK( socketpair( AF_UNIX, SOCK_STREAM, 0, socks ) );
+	CHECK( pipe( pipes ) );
+	
+	char hello[] = "hello";
+	char world[] = " world";
+	
+	iovec iov[ 2 ] =
+	{
+		{ hello, 5 },
+		{ world, 6 },
+	};
+	
+	send_message_with_fd( socks[ 1 ], iov, 2, pipes[ 1 ] );
+	
+	close( pipes[ 1 ] );
+	
+	char buffer[ 16 ];
+	
+	int passed_fd;
+	
+	const ssize_t n_read = recv_with_fd( socks[ 0 ], buffer, sizeof buffer, passed_fd );
+	
+	EXPECT( n_read == 11  &&  memcmp( buffer, "hello world", 11 ) == 0 );
+	
+	EXPECT( passed_fd >= 0 );
+	
+	// The received descriptor is the write end of our pipe.
+	
+	CHECK( write( passed_fd, "x", 1 ) );
+	
+	close( passed_fd );
+	
+	EXPECT( read( pipes[ 0 ], buffer, sizeof buffer ) == 1  &&  buffer[ 0 ] == 'x' );
+	
+	close( pipes[ 0 ] );
+	close( socks[ 0 ] );
+	close( socks[ 1 ] );
+}
+
+static void no_fd()
+{
+	int socks[ 2 ];
+	
+	CHECK( socketpair( AF_UNIX, SOCK_STREAM, 0, socks ) );
+	
+	CHECK( write( socks[ 1 ], "plain", 5 ) );
+	
+	char buffer[ 16 ];
+	
+	int passed_fd = 0;
+	
+	const ssize_t n_read = recv_with_fd( socks[ 0 ], buffer, sizeof buffer, passed_fd );
+	
+	EXPECT( n_read == 5  &&  memcmp( buffer, "plain", 5 ) == 0 );
+	
+	// Ordinary data carries no descriptor.
+	
+	EXPECT( passed_fd == -1 );
+	
+	close( socks[ 0 ] );
+	close( socks[ 1 ] );
+}
+
+int main( int argc, char** argv )
+{
+	tap::start( "pass_fd", n_tests );
+	
+	unix_sockets();
+	passing();
+	no_fd();
+	
+	return 0;
+}
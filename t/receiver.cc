@@ -0,0 +1,195 @@
+/*
+	receiver.cc
+	-----------
+*/
+
+// Standard C
+#include <errno.h>
+#include <string.h>
+
+// freemount
+#include "freemount/frame_size.hh"
+#include "freemount/receiver.hh"
+
+// tap-out
+#include "tap/test.hh"
+
+
+static const unsigned n_tests = 4 + 3 + 4 + 3 + 3 + 2;
+
+
+using namespace freemount;
+
+
+static char frames[ 8 * 4 + 4 ];
+
+static void make_frames()
+{
+	// Three empty frames with types 1, 2, 3, and a 3-byte frame of type 4.
+	
+	for ( int i = 0;  i < 4;  ++i )
+	{
+		frame_header& h = *(frame_header*) (frames + 8 * i);
+		
+		h.type = i + 1;
+	}
+	
+	frame_header& last = *(frame_header*) (frames + 8 * 3);
+	
+	last.big_size = iota::big_u16( 3 );
+	
+	memcpy( frames + 8 * 4, "xyz", 3 );
+}
+
+static int n_frames;
+static int n_batches;
+static int n_batch_ends;
+static int stop_type;
+
+static int frame_handler( void* that, const frame_header& frame )
+{
+	++n_frames;
+	
+	return frame.type == stop_type;
+}
+
+static int batch_handler( void*                that,
+                          const frame_header*  begin,
+                          const frame_header*& end )
+{
+	++n_batches;
+	
+	return dispatch_frames( &frame_handler, that, begin, end );
+}
+
+static int batch_end( void* that )
+{
+	++n_batch_ends;
+	
+	return 0;
+}
+
+static void reset()
+{
+	n_frames     = 0;
+	n_batches    = 0;
+	n_batch_ends = 0;
+	stop_type    = 0;
+}
+
+static void per_frame()
+{
+	reset();
+	
+	data_receiver r( &frame_handler, NULL, &batch_end );
+	
+	// Split the last frame's payload across reads.
+	
+	EXPECT( r.recv_bytes( frames, 34 ) == 0 );
+	EXPECT( n_frames == 3  &&  n_batch_ends == 1 );
+	
+	EXPECT( r.recv_bytes( frames + 34, 2 ) == 0 );
+	EXPECT( n_frames == 4  &&  n_batch_ends == 2 );
+}
+
+static void stop_and_resume()
+{
+	reset();
+	
+	stop_type = 2;
+	
+	data_receiver r( &frame_handler, NULL, &batch_end );
+	
+	EXPECT( r.recv_bytes( frames, sizeof frames ) == 1 );
+	EXPECT( n_frames == 2  &&  n_batch_ends == 1 );
+	
+	// The remaining frames are still buffered.
+	
+	EXPECT( r.recv_bytes( "", 0 ) == 0  &&  n_frames == 4 );
+}
+
+static void batched()
+{
+	reset();
+	
+	data_receiver r( &batch_handler, NULL, &batch_end );
+	
+	EXPECT( r.recv_bytes( frames, 12 ) == 0 );
+	EXPECT( n_frames == 1  &&  n_batches == 1 );
+	
+	EXPECT( r.recv_bytes( frames + 12, sizeof frames - 12 ) == 0 );
+	EXPECT( n_frames == 4  &&  n_batches == 2  &&  n_batch_ends == 2 );
+}
+
+static void batch_stop_and_resume()
+{
+	reset();
+	
+	stop_type = 2;
+	
+	data_receiver r( &batch_handler, NULL, &batch_end );
+	
+	EXPECT( r.recv_bytes( frames, sizeof frames ) == 1 );
+	EXPECT( n_frames == 2  &&  n_batches == 1  &&  n_batch_ends == 1 );
+	
+	// As with a per-frame handler, the remaining frames are still buffered.
+	
+	EXPECT( r.recv_bytes( "", 0 ) == 0  &&  n_frames == 4  &&  n_batches == 2 );
+}
+
+static void jumbo()
+{
+	reset();
+	
+	const uint32_t size = 0x12345;
+	
+	static char frame[ sizeof (frame_header) + 0x12348 ];
+	
+	frame_header& h = *(frame_header*) frame;
+	
+	h.type = 72;
+	
+	set_payload_size( h, size );
+	
+	EXPECT( h._0 == 0x01  &&  get_payload_size( h ) == size );
+	
+	data_receiver r( &frame_handler, NULL );
+	
+	EXPECT( r.recv_bytes( frame, 0x10000 ) == 0  &&  n_frames == 0 );
+	
+	EXPECT( r.recv_bytes( frame + 0x10000, sizeof frame - 0x10000 ) == 0  &&  n_frames == 1 );
+}
+
+static void oversized()
+{
+	reset();
+	
+	char bytes[ 8 + 8 ] = { 0, 1 };  // an empty frame of type 1
+	
+	frame_header& h = *(frame_header*) (bytes + 8);
+	
+	set_payload_size( h, max_jumbo_payload + 4 );
+	
+	data_receiver r( &frame_handler, NULL );
+	
+	// The frame before the oversized one is still handled.
+	
+	EXPECT( r.recv_bytes( bytes, sizeof bytes ) == -EMSGSIZE );
+	EXPECT( n_frames == 1 );
+}
+
+int main( int argc, char** argv )
+{
+	tap::start( "receiver", n_tests );
+	
+	make_frames();
+	
+	per_frame();
+	stop_and_resume();
+	batched();
+	batch_stop_and_resume();
+	jumbo();
+	oversized();
+	
+	return 0;
+}
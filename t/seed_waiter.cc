@@ -0,0 +1,112 @@
+/*
+	seed_waiter.cc
+	--------------
+*/
+
+// POSIX
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+// freemount-client
+#include "freemount/seed_waiter.hh"
+
+// tap-out
+#include "tap/test.hh"
+
+
+static const unsigned n_tests = 2 + 1 + 1;
+
+
+using namespace freemount;
+
+
+static volatile uint32_t seed;
+
+static
+uint64_t milliseconds()
+{
+	timeval tv;
+	
+	gettimeofday( &tv, NULL );
+	
+	return uint64_t( tv.tv_sec ) * 1000 + tv.tv_usec / 1000;
+}
+
+static
+void* produce( void* )
+{
+	usleep( 100 * 1000 );
+	
+	seed = 1;
+	
+	wake_seed_waiters( &seed );
+	
+	return NULL;
+}
+
+static void woken()
+{
+	/*
+		A producer that wakes waiters lets us wait for up to a second, so
+		if wake_seed_waiters() didn't work, this would take that long.
+	*/
+	
+	seed_waiter waiter( true );
+	
+	pthread_t producer;
+	
+	pthread_create( &producer, NULL, &produce, NULL );
+	
+	const uint64_t start = milliseconds();
+	
+	while ( seed == 0 )
+	{
+		waiter.wait( &seed, 0 );
+	}
+	
+	const uint64_t elapsed = milliseconds() - start;
+	
+	pthread_join( producer, NULL );
+	
+	EXPECT( seed == 1 );
+	
+	EXPECT( elapsed >= 50  &&  elapsed < 900 );
+}
+
+static void polling()
+{
+	// Otherwise, each wait times out quickly.
+	
+	seed_waiter waiter( false );
+	
+	const uint64_t start = milliseconds();
+	
+	waiter.wait( &seed, seed );
+	
+	const uint64_t elapsed = milliseconds() - start;
+	
+	EXPECT( elapsed < 500 );
+}
+
+static void already_changed()
+{
+	seed_waiter waiter( true );
+	
+	const uint64_t start = milliseconds();
+	
+	waiter.wait( &seed, seed + 1 );
+	
+	EXPECT( milliseconds() - start < 500 );
+}
+
+int main( int argc, char** argv )
+{
+	tap::start( "seed_waiter", n_tests );
+	
+	woken();
+	polling();
+	already_changed();
+	
+	return 0;
+}
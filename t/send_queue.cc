@@ -0,0 +1,163 @@
+/*
+	send_queue.cc
+	-------------
+*/
+
+// POSIX
+#include <fcntl.h>
+#include <unistd.h>
+
+// Standard C
+#include <string.h>
+
+// freemount
+#include "freemount/queue_utils.hh"
+#include "freemount/send_queue.hh"
+
+// tap-out
+#include "tap/check.hh"
+#include "tap/test.hh"
+
+
+static const unsigned n_tests = 3 + 4 + 3 + 3;
+
+
+using freemount::send_queue;
+using freemount::send_cork;
+
+
+static int fds[ 2 ];
+
+static char buffer[ 16384 ];
+
+static ssize_t n_available()
+{
+	CHECK( fcntl( fds[0], F_SETFL, O_NONBLOCK ) );
+	
+	ssize_t n = read( fds[0], buffer, sizeof buffer );
+	
+	CHECK( fcntl( fds[0], F_SETFL, 0 ) );
+	
+	return n < 0 ? 0 : n;
+}
+
+static void gather()
+{
+	send_queue queue( fds[1] );
+	
+	const char* payload = "0123456789";
+	
+	queue.add( "<", 1 );
+	queue.add_ref( payload, 10 );
+	queue.add( ">", 1 );
+	
+	EXPECT( n_available() == 0 );
+	
+	queue.flush();
+	
+	EXPECT( n_available() == 12 );
+	
+	EXPECT( memcmp( buffer, "<0123456789>", 12 ) == 0 );
+}
+
+static void cork()
+{
+	send_queue queue( fds[1] );
+	
+	{
+		send_cork outer( queue );
+		
+		queue.add( "abc", 3 );
+		
+		{
+			send_cork inner( queue );
+			
+			queue.add( "def", 3 );
+			queue.flush();
+		}
+		
+		EXPECT( n_available() == 0 );
+		
+		queue.flush();
+		
+		EXPECT( n_available() == 0 );
+	}
+	
+	EXPECT( n_available() == 6 );
+	
+	EXPECT( memcmp( buffer, "abcdef", 6 ) == 0 );
+}
+
+static void overflow()
+{
+	static char big[ 8192 ];
+	
+	memset( big, 'x', sizeof big );
+	
+	send_queue queue( fds[1] );
+	
+	send_cork cork( queue );
+	
+	queue.add( "<", 1 );
+	
+	// Too big for the buffer, so it's written immediately, even when corked.
+	
+	queue.add( big, sizeof big );
+	
+	EXPECT( n_available() == 1 + sizeof big );
+	
+	EXPECT( buffer[ 0 ] == '<'  &&  buffer[ sizeof big ] == 'x' );
+	
+	queue.add( ">", 1 );
+	
+	EXPECT( n_available() == 0 );
+}
+
+static void frame_boundaries()
+{
+	static char big[ 5001 ];
+	
+	n_available();  // discard overflow()'s last byte
+	
+	send_queue queue( fds[1] );
+	
+	send_cork cork( queue );
+	
+	// Each frame is 12 bytes, so 341 of them fill all but 4 of 4096 bytes.
+	
+	for ( int i = 0;  i < 341;  ++i )
+	{
+		freemount::queue_int( queue, 0, 0x12345678u );
+	}
+	
+	EXPECT( n_available() == 0 );
+	
+	// The next frame doesn't fit, so the buffer is written without it.
+	
+	freemount::queue_int( queue, 0, 0x12345678u );
+	
+	EXPECT( n_available() == 341 * 12 );
+	
+	// A copied payload too big for the buffer goes out with its padding.
+	
+	freemount::queue_string( queue, 0, big, sizeof big );
+	
+	EXPECT( n_available() == 12 + 8 + sizeof big + 3 );
+}
+
+int main( int argc, char** argv )
+{
+	tap::start( "send_queue", n_tests );
+	
+	CHECK( pipe( fds ) );
+	
+	gather();
+	cork();
+	overflow();
+	frame_boundaries();
+	
+	close( fds[0] );
+	close( fds[1] );
+	
+	return 0;
+}
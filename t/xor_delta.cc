@@ -0,0 +1,90 @@
+/*
+	xor_delta.cc
+	------------
+*/
+
+// Standard C
+#include <errno.h>
+#include <string.h>
+
+// freemount
+#include "freemount/xor_delta.hh"
+
+// tap-out
+#include "tap/test.hh"
+
+
+static const unsigned n_tests = 3 + 2;
+
+
+using namespace freemount;
+
+
+static void round_trip()
+{
+	char prior[ 1000 ];
+	char data [ 1000 ];
+	
+	for ( size_t i = 0;  i < sizeof prior;  ++i )
+	{
+		prior[ i ] = i * 7;
+	}
+	
+	memcpy( data, prior, sizeof data );
+	
+	char out[ sizeof data + 10 ];
+	
+	EXPECT( encode_xor_delta( data, prior, sizeof data, out ) == 0 );
+	
+	data[ 3 ] ^= 1;
+	data[ 5 ] ^= 2;
+	
+	memset( data + 500, 0xAA, 100 );
+	
+	const size_t size = encode_xor_delta( data, prior, sizeof data, out );
+	
+	EXPECT( size > 100  &&  size < 120 );
+	
+	char target[ sizeof prior ];
+	
+	memcpy( target, prior, sizeof target );
+	
+	const int result = apply_xor_delta( out, size, target, sizeof target );
+	
+	EXPECT( result == 0  &&  memcmp( target, data, sizeof data ) == 0 );
+}
+
+static void limits()
+{
+	// Alternating changes are the worst case.
+	
+	char prior[ 999 ] = { 0 };
+	char data [ 999 ];
+	
+	for ( size_t i = 0;  i < sizeof data;  ++i )
+	{
+		data[ i ] = i & 1;
+	}
+	
+	char out[ sizeof data + 10 ];
+	
+	EXPECT( encode_xor_delta( data, prior, sizeof data, out ) <= max_xor_delta_size( sizeof data ) );
+	
+	// A delta must not reach past the end of its target.
+	
+	const char overrun[] = { 8, 3, 1, 2, 3 };
+	
+	char target[ 10 ] = { 0 };
+	
+	EXPECT( apply_xor_delta( overrun, sizeof overrun, target, sizeof target ) == -EBADMSG );
+}
+
+int main( int argc, char** argv )
+{
+	tap::start( "xor_delta", n_tests );
+	
+	round_trip();
+	limits();
+	
+	return 0;
+}